@@ -0,0 +1,360 @@
+// Replays the demo scenes without a display and reports how fast the environment updates them.
+// Each run prints one line of JSON, with the time spent in each phase of the update, so results can be collected and
+// compared across releases.
+#define _USE_MATH_DEFINES
+
+#include <math.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../include/cpparticles.hpp"
+
+
+// Settings shared by every run, taken from the command line.
+struct Options {
+	std::vector<std::string> scenes = {"collisions", "gas_cloud", "soft_body", "cloth"};
+	std::vector<int> counts = {1000, 10000, 100000, 1000000};
+	int steps = 0;
+	int threads = 1;
+	unsigned seed = 1;
+	bool reference = false;
+	Broadphase broadphase = UNIFORM_GRID;
+	bool sleep = false;
+	SpringSolver springSolver = SPRING_FORCES;
+	Integrator integrator = SEMI_IMPLICIT_EULER;
+	int maxSubsteps = 1;
+	const char *trace = nullptr;
+};
+
+
+// Returns the width of an environment that holds count particles at the same density as a demo holding demoCount
+// particles in 800 x 600.
+static float scaleWidth(int count, int demoCount) {
+	return 800 * sqrt(std::max(1.0, (double)count / demoCount));
+}
+
+
+// Builds the collisions scene: particles with random attributes bouncing around under gravity.
+static Environment * collisions(int count, unsigned seed) {
+	float scale = scaleWidth(count, 10) / 800;
+	Environment *env = new Environment(800 * scale, 600 * scale);
+	env->addParticles(count, ParticleDistribution(), seed);
+	return env;
+}
+
+
+// Builds the gas cloud scene: small particles attracting each other and merging, with no gravity or walls.
+static Environment * gasCloud(int count, unsigned seed) {
+	float scale = scaleWidth(count, 500) / 800;
+	Environment *env = new Environment(800 * scale, 600 * scale);
+	env->setAllowAccelerate(false);
+	env->setAllowAttract(true);
+	env->setAllowBounce(false);
+	env->setAllowCollide(false);
+	env->setAllowCombine(true);
+	env->setAllowDrag(false);
+	env->setMergeSize([](float mass) { return 0.5 * pow(mass, 0.5); });
+	ParticleDistribution distribution;
+	distribution.minMass = 1;
+	distribution.maxMass = 5;
+	distribution.maxSpeed = 0;
+	distribution.size = [](float mass) { return 0.5 * pow(mass, 0.5); };
+	env->addParticles(count, distribution, seed);
+	return env;
+}
+
+
+// Builds the soft body scene: squares of four particles braced by six springs, laid out in rows and falling under
+// gravity. The squares are jittered so that they do not all land at once.
+static Environment * softBody(int count, unsigned seed) {
+	int bodies = std::max(1, count / 4);
+	int columns = static_cast<int>(ceil(sqrt(bodies * 4.0 / 3)));
+	int rows = (bodies + columns - 1) / columns;
+	Environment *env = new Environment(columns * 250 + 50, rows * 250 + 50);
+	Random random(seed);
+	for (int b = 0; b < bodies; b++) {
+		float left = 50 + (b % columns) * 250 + random.uniform(-10, 10);
+		float top = 50 + (b / columns) * 250 + random.uniform(-10, 10);
+		Particle p1 = env->addParticle(left, top, 10, 600, 0, 0, 0.1);
+		Particle p2 = env->addParticle(left + 200, top, 10, 600, 0, 0, 0.1);
+		Particle p3 = env->addParticle(left + 200, top + 200, 10, 600, 0, 0, 0.1);
+		Particle p4 = env->addParticle(left, top + 200, 10, 600, 0, 0, 0.1);
+		env->addSpring(p1, p2, 200, 50);
+		env->addSpring(p2, p3, 200, 50);
+		env->addSpring(p3, p4, 200, 50);
+		env->addSpring(p4, p1, 200, 50);
+		env->addSpring(p1, p3, 200, 50);
+		env->addSpring(p2, p4, 200, 50);
+	}
+	return env;
+}
+
+
+// Builds the cloth scene: one sheet of particles in a braced grid lattice, falling under gravity onto the floor. Each
+// particle is nudged from its place in the lattice by the seed, so that the springs start slightly stretched.
+static Environment * cloth(int count, unsigned seed) {
+	int columns = std::max(2, static_cast<int>(ceil(sqrt(count * 4.0 / 3))));
+	int rows = std::max(2, count / columns);
+	Environment *env = new Environment(columns * 10 + 100, rows * 20 + 100);
+	LatticeLayout layout;
+	layout.x = 50;
+	layout.y = 50;
+	layout.columns = columns;
+	layout.rows = rows;
+	layout.spacing = 10;
+	layout.size = 4;
+	layout.strength = 5;
+	std::vector<Particle> lattice(columns * rows);
+	env->addLattice(layout, lattice.data());
+	Random random(seed);
+	for (Particle particle : lattice) {
+		particle.setX(particle.getX() + random.uniform(-0.5, 0.5));
+		particle.setY(particle.getY() + random.uniform(-0.5, 0.5));
+	}
+	return env;
+}
+
+
+// Returns the peak resident set size of the process so far, in kilobytes.
+static long peakRss() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+}
+
+
+// Splits a comma separated list.
+static std::vector<std::string> split(const char *list) {
+	std::vector<std::string> result;
+	std::string item;
+	for (const char *c = list; ; c++) {
+		if (*c == ',' || *c == '\0') {
+			if (!item.empty()) {
+				result.push_back(item);
+			}
+			item.clear();
+			if (*c == '\0') {
+				return result;
+			}
+		} else {
+			item += *c;
+		}
+	}
+}
+
+
+// Prints how to use the benchmark.
+static void usage(const char *name) {
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  --scenes LIST     comma separated scenes: collisions, gas_cloud, soft_body, cloth (default: all)\n"
+		"  --particles LIST  comma separated particle counts (default: 1000,10000,100000,1000000)\n"
+		"  --steps N         timed steps per run (default: scaled down for larger counts)\n"
+		"  --threads N       threads used by the environment (default: 1)\n"
+		"  --seed N          seed for the particles' attributes (default: 1)\n"
+		"  --broadphase NAME grid or sweep (default: grid)\n"
+		"  --reference       use the brute force broadphase and all-pairs attraction\n"
+		"  --sleep           put resting particles to sleep\n"
+		"  --springs NAME    forces or constraints (default: forces)\n"
+		"  --integrator NAME euler, semi_implicit or verlet (default: semi_implicit)\n"
+		"  --substeps N      most substeps each update may be divided into (default: 1)\n"
+		"  --trace FILE      write a Chrome trace of the timed steps (needs CPPARTICLES_TRACE)\n",
+		name);
+}
+
+
+// Parses the command line into options, returning false if it is malformed.
+static bool parse(int argc, char **argv, Options &options) {
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (strcmp(arg, "--reference") == 0) {
+			options.reference = true;
+			continue;
+		}
+		if (strcmp(arg, "--sleep") == 0) {
+			options.sleep = true;
+			continue;
+		}
+		if (!value) {
+			return false;
+		}
+		if (strcmp(arg, "--scenes") == 0) {
+			options.scenes = split(value);
+		} else if (strcmp(arg, "--particles") == 0) {
+			options.counts.clear();
+			for (std::string const& count : split(value)) {
+				options.counts.push_back(atoi(count.c_str()));
+			}
+		} else if (strcmp(arg, "--steps") == 0) {
+			options.steps = atoi(value);
+		} else if (strcmp(arg, "--threads") == 0) {
+			options.threads = atoi(value);
+		} else if (strcmp(arg, "--seed") == 0) {
+			options.seed = strtoul(value, nullptr, 10);
+		} else if (strcmp(arg, "--broadphase") == 0) {
+			if (strcmp(value, "grid") == 0) {
+				options.broadphase = UNIFORM_GRID;
+			} else if (strcmp(value, "sweep") == 0) {
+				options.broadphase = SWEEP_AND_PRUNE;
+			} else {
+				return false;
+			}
+		} else if (strcmp(arg, "--springs") == 0) {
+			if (strcmp(value, "forces") == 0) {
+				options.springSolver = SPRING_FORCES;
+			} else if (strcmp(value, "constraints") == 0) {
+				options.springSolver = SPRING_CONSTRAINTS;
+			} else {
+				return false;
+			}
+		} else if (strcmp(arg, "--integrator") == 0) {
+			if (strcmp(value, "euler") == 0) {
+				options.integrator = EXPLICIT_EULER;
+			} else if (strcmp(value, "semi_implicit") == 0) {
+				options.integrator = SEMI_IMPLICIT_EULER;
+			} else if (strcmp(value, "verlet") == 0) {
+				options.integrator = VELOCITY_VERLET;
+			} else {
+				return false;
+			}
+		} else if (strcmp(arg, "--substeps") == 0) {
+			options.maxSubsteps = atoi(value);
+		} else if (strcmp(arg, "--trace") == 0) {
+			options.trace = value;
+		} else {
+			return false;
+		}
+		i++;
+	}
+	return true;
+}
+
+
+// Builds and times one scene, then prints its results.
+static bool run(std::string const& scene, int count, Options const& options) {
+	Environment *env;
+	if (scene == "collisions") {
+		env = collisions(count, options.seed);
+	} else if (scene == "gas_cloud") {
+		env = gasCloud(count, options.seed);
+	} else if (scene == "soft_body") {
+		env = softBody(count, options.seed);
+	} else if (scene == "cloth") {
+		env = cloth(count, options.seed);
+	} else {
+		fprintf(stderr, "Unknown scene: %s\n", scene.c_str());
+		return false;
+	}
+	env->setBroadphase(options.reference ? BRUTE_FORCE : options.broadphase);
+	env->setAttraction(options.reference ? ALL_PAIRS : BARNES_HUT);
+	env->setThreadCount(options.threads);
+	env->setAllowSleep(options.sleep);
+	env->setSpringSolver(options.springSolver);
+	env->setIntegrator(options.integrator);
+	env->setMaxSubsteps(options.maxSubsteps);
+	int steps = options.steps > 0 ? options.steps : std::max(5, std::min(200, 20000000 / std::max(count, 1)));
+
+	// The first update sizes the environment's buffers, so it is left out of the timings.
+	env->update();
+	env->setCollectStats(true);
+	StepStats totals;
+	env->setStatsCallback([&](StepStats const& stats) {
+		for (int phase = 0; phase < PHASE_COUNT; phase++) {
+			totals.phaseSeconds[phase] += stats.phaseSeconds[phase];
+		}
+		totals.substeps += stats.substeps;
+		totals.pairTests += stats.pairTests;
+		totals.collisions += stats.collisions;
+		totals.merges += stats.merges;
+		totals.allocations += stats.allocations;
+	});
+	Tracer::setEnabled(options.trace != nullptr);
+	auto start = std::chrono::steady_clock::now();
+	for (int step = 0; step < steps; step++) {
+		env->update();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	Tracer::setEnabled(false);
+
+	const char *broadphases[] = {"brute_force", "grid", "sweep"};
+	const char *springSolvers[] = {"forces", "constraints"};
+	const char *integrators[] = {"euler", "semi_implicit", "verlet"};
+	const char *phases[PHASE_COUNT] = {"integrate", "attract", "collide", "combine", "springs", "sleep", "publish", "record"};
+	std::string phaseSeconds;
+	for (int phase = 0; phase < PHASE_COUNT; phase++) {
+		char field[64];
+		snprintf(field, sizeof(field), "%s\"%s\": %.6f", phase > 0 ? ", " : "", phases[phase], totals.phaseSeconds[phase]);
+		phaseSeconds += field;
+	}
+	printf("{\"scene\": \"%s\", \"particles\": %d, \"final_particles\": %d, \"springs\": %d, \"sleeping\": %d, \"steps\": %d, "
+		"\"threads\": %d, \"seed\": %u, \"reference\": %s, \"broadphase\": \"%s\", \"spring_solver\": \"%s\", "
+		"\"integrator\": \"%s\", \"seconds\": %.6f, \"steps_per_second\": %.3f, \"ns_per_particle_step\": %.3f, "
+		"\"substeps_per_step\": %.2f, \"pair_tests_per_step\": %.1f, \"collisions_per_step\": %.1f, "
+		"\"merges\": %ld, \"allocations\": %ld, \"phase_seconds\": {%s}, \"peak_rss_kb\": %ld}\n",
+		scene.c_str(), count, env->getStats().particles, env->getStats().springs, env->getStats().sleeping, steps, env->getThreadCount(),
+		options.seed, options.reference ? "true" : "false", broadphases[env->getBroadphase()],
+		springSolvers[env->getSpringSolver()], integrators[env->getIntegrator()], seconds, steps / seconds,
+		seconds * 1e9 / ((double)count * steps), (double)totals.substeps / steps, (double)totals.pairTests / steps,
+		(double)totals.collisions / steps, totals.merges, totals.allocations, phaseSeconds.c_str(), peakRss());
+	fflush(stdout);
+	delete env;
+	return true;
+}
+
+
+// Runs one scene in a child process of its own, so that the peak memory use it reports is its own rather than that of
+// a larger scene run before it, and returns whether it succeeded.
+static bool runIsolated(std::string const& scene, int count, Options const& options) {
+	fflush(stdout);
+	pid_t child = fork();
+	if (child < 0) {
+		return run(scene, count, options);
+	}
+	if (child == 0) {
+		bool succeeded = run(scene, count, options);
+		fflush(stdout);
+		_exit(succeeded ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	int status;
+	return waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+
+int main(int argc, char **argv) {
+	Options options;
+	if (!parse(argc, argv, options)) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+#ifndef CPPARTICLES_TRACE
+	if (options.trace) {
+		fprintf(stderr, "Warning: the library was built without CPPARTICLES_TRACE, so the trace will be empty.\n");
+	}
+#endif
+	Tracer::setThreadName("main");
+	// A trace collects the spans of every scene, so traced scenes are run in this process, and each one's peak memory
+	// use also covers the scenes before it.
+	for (std::string const& scene : options.scenes) {
+		for (int count : options.counts) {
+			if (!(options.trace ? run(scene, count, options) : runIsolated(scene, count, options))) {
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	if (options.trace && !Tracer::write(options.trace)) {
+		fprintf(stderr, "Could not write the trace to %s\n", options.trace);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,60 @@
+// Draws the particles and springs extracted into a RenderBatch with SFML, shared by the demos.
+#ifndef batch_drawer_hpp
+#define batch_drawer_hpp
+
+#include <SFML/Graphics.hpp>
+#include "../include/cpparticles.hpp"
+
+
+// Draws every particle of a batch as a textured square in one draw call, and every spring as a line in another. The
+// vertex arrays are kept between frames, so drawing allocates nothing once they have grown to fit.
+class BatchDrawer {
+public:
+	BatchDrawer() {
+		// A circle is drawn once into a texture, which every particle's square is then drawn with.
+		sf::RenderTexture target;
+		target.create(2 * RADIUS, 2 * RADIUS);
+		target.clear(sf::Color::Transparent);
+		sf::CircleShape circle(RADIUS, 64);
+		target.draw(circle);
+		target.display();
+		circleTexture = target.getTexture();
+		circleTexture.setSmooth(true);
+		circles.setPrimitiveType(sf::Quads);
+		lines.setPrimitiveType(sf::Lines);
+	}
+
+	// Draws the batch's springs, then its particles on top.
+	void draw(sf::RenderTarget &target, RenderBatch const& batch, sf::Color color=sf::Color::White) {
+		lines.resize(2 * batch.springCount);
+		for (int k = 0; k < batch.springCount; k++) {
+			const float *segment = &batch.springs[4 * k];
+			lines[2 * k] = sf::Vertex(sf::Vector2f(segment[0], segment[1]), color);
+			lines[2 * k + 1] = sf::Vertex(sf::Vector2f(segment[2], segment[3]), color);
+		}
+		circles.resize(4 * batch.particleCount);
+		float size = 2 * RADIUS;
+		for (int i = 0; i < batch.particleCount; i++) {
+			const float *instance = &batch.particles[batch.stride * i];
+			float x = instance[0];
+			float y = instance[1];
+			float r = instance[2];
+			circles[4 * i] = sf::Vertex(sf::Vector2f(x - r, y - r), color, sf::Vector2f(0, 0));
+			circles[4 * i + 1] = sf::Vertex(sf::Vector2f(x + r, y - r), color, sf::Vector2f(size, 0));
+			circles[4 * i + 2] = sf::Vertex(sf::Vector2f(x + r, y + r), color, sf::Vector2f(size, size));
+			circles[4 * i + 3] = sf::Vertex(sf::Vector2f(x - r, y + r), color, sf::Vector2f(0, size));
+		}
+		if (batch.springCount > 0) {
+			target.draw(lines);
+		}
+		target.draw(circles, &circleTexture);
+	}
+
+protected:
+	static constexpr float RADIUS = 32;
+	sf::Texture circleTexture;
+	sf::VertexArray circles;
+	sf::VertexArray lines;
+};
+
+#endif // batch_drawer_hpp
@@ -1,16 +1,20 @@
 // Demonstrates particle physics in a 'regular' environment with gravity.
 #include <SFML/Graphics.hpp>
 #include "../include/cpparticles.hpp"
+#include "batch_drawer.hpp"
 
 int main() {
 	
 	// Set up the environment.
 	Environment *env = new Environment(800, 600);
-	Particle *selectedParticle = nullptr;
+	env->setAllowSleep(true);
+	Particle selectedParticle;
 	
 	// Create the main window.
 	sf::RenderWindow window(sf::VideoMode(env->getWidth(), env->getHeight()), "Collision Simulation");
 	window.setFramerateLimit(60);
+	BatchDrawer drawer;
+	RenderBatch batch;
 	
 	// Add random particles to the environment.
 	for (int i = 0; i < 10; i++) {
@@ -47,7 +51,7 @@ int main() {
 			// Release left mouse button: Release a particle.
 			if (event.type == sf::Event::MouseButtonReleased) {
 				if (event.mouseButton.button == sf::Mouse::Left) {
-					selectedParticle = nullptr;
+					selectedParticle = Particle();
 				}
 			}
 		}
@@ -55,27 +59,24 @@ int main() {
 		// Clear the window.
 		window.clear();
 		
-		// Update the environment.
-		env->update();
-		
 		// Move the selected particle to the cursor's position.
 		if (selectedParticle) {
 			float mouseX = sf::Mouse::getPosition(window).x;
 			float mouseY = sf::Mouse::getPosition(window).y;
-			selectedParticle->moveTo(mouseX, mouseY);
+			env->wake(selectedParticle);
+			selectedParticle.moveTo(mouseX, mouseY);
 		}
 		
+		// Update the environment while the last step is drawn.
+		std::future<void> step = env->stepAsync();
+		
 		// Draw particles.
-		for (int i = 0; i < env->getParticles().size(); i++) {
-			Particle *particle = env->getParticles()[i];
-			sf::CircleShape circle(particle->getSize());
-			circle.setOrigin(particle->getSize(), particle->getSize());
-			circle.setPosition(particle->getX(), particle->getY());
-			window.draw(circle);
-		}
+		env->extractRender(RenderView(), batch);
+		drawer.draw(window, batch);
 		
 		// Update the window.
 		window.display();
+		step.wait();
 	}
 	
 	return EXIT_SUCCESS;
@@ -5,6 +5,7 @@
 #include <random>
 #include <SFML/Graphics.hpp>
 #include "../include/cpparticles.hpp"
+#include "batch_drawer.hpp"
 
 int main() {
 	
@@ -16,31 +17,33 @@ int main() {
 	env->setAllowCollide(false);
 	env->setAllowCombine(true);
 	env->setAllowDrag(false);
+	env->setMergeSize([](float mass) { return 0.5 * pow(mass, 0.5); });
 	
 	// Create the main window.
 	sf::RenderWindow window(sf::VideoMode(env->getWidth(), env->getHeight()), "Gas Cloud Simulation");
 	window.setFramerateLimit(60);
 	
-	// Set up the 'camera' values for viewing the environment.
-	float dx = 0;
-	float dy = 0;
-	float mx = 0;
-	float my = 0;
-	float magnification = 1;
-	bool paused = false;
-	
-	std::random_device rd;
-	std::mt19937 engine(rd());
-	std::uniform_int_distribution<int> massDist(1,5);
+	BatchDrawer drawer;
+	RenderBatch batch;
 	
+	// Set up the 'camera' for viewing the environment. Zooming keeps the centre of the window where it is.
+	RenderView view;
+	auto zoom = [&](float factor) {
+		float centreX = view.left + env->getWidth() / (2 * view.zoom);
+		float centreY = view.top + env->getHeight() / (2 * view.zoom);
+		view.zoom *= factor;
+		view.left = centreX - env->getWidth() / (2 * view.zoom);
+		view.top = centreY - env->getHeight() / (2 * view.zoom);
+	};
+	bool paused = false;
 	// Add randomized particles to the environment.
-	for (int i = 0; i < 500; i++) {
-		int mass = massDist(rd);
-		float size = 0.5 * pow(mass, 0.5);
-		std::uniform_int_distribution<int> xDist(size, env->getWidth() - size);
-		std::uniform_int_distribution<int> yDist(size, env->getHeight() - size);
-		env->addParticle(xDist(rd), yDist(rd), size, mass, 0);
-	}
+	ParticleDistribution distribution;
+	distribution.minMass = 1;
+	distribution.maxMass = 5;
+	distribution.maxSpeed = 0;
+	distribution.size = [](float mass) { return 0.5 * pow(mass, 0.5); };
+	std::random_device rd;
+	env->addParticles(500, distribution, rd());
 	
 	while (window.isOpen()) {
 		
@@ -61,45 +64,37 @@ int main() {
 				
 				// Left arrow: move view window to the left.
 				if (event.key.code == sf::Keyboard::Left) {
-					dx += 0.2 * env->getWidth() / (magnification * 10);
+					view.left -= 0.2 * env->getWidth() / (view.zoom * 10);
 				}
 				
 				// Right arrow: move view window to the right.
 				if (event.key.code == sf::Keyboard::Right) {
-					dx += -0.2 * env->getWidth() / (magnification * 10);
+					view.left += 0.2 * env->getWidth() / (view.zoom * 10);
 				}
 				
 				// Up arrow: move view window up.
 				if (event.key.code == sf::Keyboard::Up) {
-					dy += 0.2 * env->getHeight() / (magnification * 10);
+					view.top -= 0.2 * env->getHeight() / (view.zoom * 10);
 				}
 				
 				// Down arrow: move view window down.
 				if (event.key.code == sf::Keyboard::Down) {
-					dy += -0.2 * env->getHeight() / (magnification * 10);
+					view.top += 0.2 * env->getHeight() / (view.zoom * 10);
 				}
 				
 				// Right bracket: zoom in.
 				if (event.key.code == sf::Keyboard::RBracket) {
-					magnification *= 1.2;
-					mx = (1 - magnification) * env->getWidth() / 2;
-					my = (1 - magnification) * env->getHeight() / 2;
+					zoom(1.2);
 				}
 				
 				// Left bracket: zoom out.
 				if (event.key.code == sf::Keyboard::LBracket) {
-					magnification *= 0.8;
-					mx = (1 - magnification) * env->getWidth() / 2;
-					my = (1 - magnification) * env->getHeight() / 2;
+					zoom(0.8);
 				}
 				
 				// "R" key: reset view window.
 				if (event.key.code == sf::Keyboard::R) {
-					dx = 0;
-					dy = 0;
-					mx = 0;
-					my = 0;
-					magnification = 1;
+					view = RenderView();
 				}
 				
 				// Space: toggle pause.
@@ -116,34 +111,21 @@ int main() {
 		// Clear the window.
 		window.clear();
 		
-		// Update the environment.
+		// Update the environment while the last step is drawn.
+		std::future<void> step;
 		if (not paused) {
-			env->update();
+			step = env->stepAsync();
 		}
 		
-		for (int i = 0; i < env->getParticles().size(); i++) {
-			Particle *particle = env->getParticles()[i];
-			
-			// Combine colliding particles.
-			if (particle->getCollideWith()) {
-				env->removeParticle(particle->getCollideWith());
-				particle->setSize(0.5 * pow(particle->getMass(), 0.5));
-			}
-			
-			// Update view window by changing the position and size of the drawn particles.
-			float x = mx + (dx + particle->getX()) * magnification;
-			float y = my + (dy + particle->getY()) * magnification;
-			float size = particle->getSize() * magnification;
-			
-			// Draw particles.
-			sf::CircleShape circle(size);
-			circle.setOrigin(size, size);
-			circle.setPosition(x, y);
-			window.draw(circle);
-		}
+		// Draw the particles in the view window.
+		env->extractRender(view, batch);
+		drawer.draw(window, batch);
 		
 		// Update the window.
 		window.display();
+		if (step.valid()) {
+			step.wait();
+		}
 	}
 	
 	return EXIT_SUCCESS;
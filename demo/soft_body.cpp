@@ -1,16 +1,20 @@
 // Demonstrates the use of springs to create a soft body.
 #include <SFML/Graphics.hpp>
 #include "../include/cpparticles.hpp"
+#include "batch_drawer.hpp"
 
 int main() {
 	
 	// Set up the environment.
 	Environment *env = new Environment(800, 600);
-	Particle *selectedParticle = nullptr;
+	env->setSpringSolver(SPRING_CONSTRAINTS);
+	Particle selectedParticle;
 	
 	// Create the main window.
 	sf::RenderWindow window(sf::VideoMode(env->getWidth(), env->getHeight()), "Soft Body Simulation");
 	window.setFramerateLimit(60);
+	BatchDrawer drawer;
+	RenderBatch batch;
 	
 	// Add particles for the soft body to the environment.
 	int size = 10;
@@ -19,10 +23,10 @@ int main() {
 	int angle = 0;
 	float elasticity = 0.1;
 	
-	Particle *p1 = env->addParticle(300, 300, size, mass, speed, angle, elasticity);
-	Particle *p2 = env->addParticle(500, 300, size, mass, speed, angle, elasticity);
-	Particle *p3 = env->addParticle(500, 500, size, mass, speed, angle, elasticity);
-	Particle *p4 = env->addParticle(300, 500, size, mass, speed, angle, elasticity);
+	Particle p1 = env->addParticle(300, 300, size, mass, speed, angle, elasticity);
+	Particle p2 = env->addParticle(500, 300, size, mass, speed, angle, elasticity);
+	Particle p3 = env->addParticle(500, 500, size, mass, speed, angle, elasticity);
+	Particle p4 = env->addParticle(300, 500, size, mass, speed, angle, elasticity);
 	
 	// Connect particles using springs to create the soft body.
 	int length = 200;
@@ -64,7 +68,7 @@ int main() {
 			
 			if (event.type == sf::Event::MouseButtonReleased) {
 				if (event.mouseButton.button == sf::Mouse::Left) {
-					selectedParticle = nullptr;
+					selectedParticle = Particle();
 				}
 			}
 		}
@@ -72,29 +76,23 @@ int main() {
 		// Clear the window.
 		window.clear();
 		
-		// Update the environment.
-		env->update();
-		
 		// Move the selected particle to the cursor's position.
 		if (selectedParticle) {
 			float mouseX = sf::Mouse::getPosition(window).x;
 			float mouseY = sf::Mouse::getPosition(window).y;
-			selectedParticle->moveTo(mouseX, mouseY);
+			selectedParticle.moveTo(mouseX, mouseY);
 		}
 		
-		// Draw springs.
-		for (int i=0; i<env->getSprings().size(); i++) {
-			Spring *spring = env->getSprings()[i];
-			sf::Vertex line[] =
-			{
-				sf::Vertex(sf::Vector2f(spring->getP1()->getX(), spring->getP1()->getY())),
-				sf::Vertex(sf::Vector2f(spring->getP2()->getX(), spring->getP2()->getY()))
-			};
-			window.draw(line, 2, sf::Lines);
-		}
+		// Update the environment while the last step is drawn.
+		std::future<void> step = env->stepAsync();
+		
+		// Draw springs and particles.
+		env->extractRender(RenderView(), batch);
+		drawer.draw(window, batch);
 		
 		// Update the window.
 		window.display();
+		step.wait();
 	}
 	
 	return EXIT_SUCCESS;
@@ -0,0 +1,39 @@
+// Header for the AlignedAllocator class and AlignedVector type.
+#ifndef aligned_vector_hpp
+#define aligned_vector_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Alignment of the arrays, in bytes. Wide enough for a cache line and the widest vector registers.
+const std::size_t ARRAY_ALIGNMENT = 64;
+// Number of arrays allocated by every AlignedAllocator, so that the allocations made by an update can be counted.
+inline std::atomic<long> alignedAllocations(0);
+
+
+// Allocates memory for a container aligned to ARRAY_ALIGNMENT bytes.
+template <typename T>
+class AlignedAllocator {
+public:
+	typedef T value_type;
+	AlignedAllocator() {}
+	template <typename U> AlignedAllocator(AlignedAllocator<U> const&) {}
+	T * allocate(std::size_t n) {
+		alignedAllocations.fetch_add(1, std::memory_order_relaxed);
+		return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(ARRAY_ALIGNMENT)));
+	}
+	void deallocate(T *p, std::size_t) {
+		::operator delete(p, std::align_val_t(ARRAY_ALIGNMENT));
+	}
+	template <typename U> bool operator==(AlignedAllocator<U> const&) const { return true; }
+	template <typename U> bool operator!=(AlignedAllocator<U> const&) const { return false; }
+};
+
+
+// A std::vector whose elements start on an ARRAY_ALIGNMENT byte boundary.
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T> >;
+
+#endif // aligned_vector_hpp
@@ -0,0 +1,74 @@
+// Header for the CheckpointHeader struct and MappedFile class.
+#ifndef checkpoint_hpp
+#define checkpoint_hpp
+
+#include <cstddef>
+#include <cstdint>
+
+// Version of the checkpoint format written by this version of the library. Checkpoints of other versions are rejected.
+const uint32_t CHECKPOINT_VERSION = 2;
+// Alignment of every array in a checkpoint file, in bytes, so that the arrays can be read straight from the mapping.
+const uint64_t CHECKPOINT_ALIGNMENT = 64;
+
+
+// Settings of the environment saved as bits of CheckpointHeader::flags.
+enum CheckpointFlag {
+	CHECKPOINT_ACCELERATE = 1 << 0,
+	CHECKPOINT_ATTRACT = 1 << 1,
+	CHECKPOINT_BOUNCE = 1 << 2,
+	CHECKPOINT_COLLIDE = 1 << 3,
+	CHECKPOINT_COMBINE = 1 << 4,
+	CHECKPOINT_DRAG = 1 << 5,
+	CHECKPOINT_MOVE = 1 << 6
+};
+
+
+// Start of a checkpoint file. The header is followed by the arrays of particle and spring attributes, each starting
+// at the offset recorded for it. Values are stored in the byte order of the machine that wrote them, which is
+// recorded so that a checkpoint from a machine of the other byte order is rejected rather than misread.
+struct CheckpointHeader {
+	char magic[8];					// "CPPCKPT" and a terminating zero.
+	uint32_t version;
+	uint32_t byteOrder;				// 0x01020304 as written by the saving machine.
+	uint32_t headerSize;
+	uint32_t flags;					// CheckpointFlag bits.
+	int32_t width;
+	int32_t height;
+	int32_t attraction;
+	int32_t broadphase;
+	int32_t integrator;
+	float airMass;
+	float elasticity;
+	float accelerationAngle;
+	float accelerationSpeed;
+	float openingAngle;
+	float softening;
+	int64_t steps;
+	int64_t particleCount;
+	int64_t springCount;
+	uint64_t particleOffsets[10];	// xs, ys, vxs, vys, sizes, masses, elasticities, drags, deferredVxs, deferredVys, as
+									// floats.
+	uint64_t springOffsets[4];		// p1s and p2s as particle indices, then lengths and strengths as floats.
+};
+
+
+// Read-only view of a whole file. On POSIX systems the file is memory mapped, so its pages are only read from disk,
+// or the page cache, as they are used. Elsewhere the file is read into memory.
+class MappedFile {
+public:
+	MappedFile() {}
+	~MappedFile();
+	MappedFile(MappedFile const&) = delete;
+	MappedFile& operator=(MappedFile const&) = delete;
+	void close();
+	const unsigned char * getData() { return data; }
+	std::size_t getSize() { return size; }
+	bool open(const char *path);
+
+protected:
+	const unsigned char *data = nullptr;
+	std::size_t size = 0;
+	bool mapped = false;
+};
+
+#endif // checkpoint_hpp
@@ -2,8 +2,27 @@
 #ifndef CPParticles_hpp
 #define CPParticles_hpp
 
+#include "checkpoint.hpp"
 #include "environment.hpp"
+#include "events.hpp"
+#include "grid.hpp"
+#include "handle_view.hpp"
+#include "kernels.hpp"
 #include "particle.hpp"
+#include "particle_store.hpp"
+#include "quadtree.hpp"
+#include "random.hpp"
+#include "render.hpp"
+#include "slot_map.hpp"
+#include "snapshot.hpp"
+#include "spatial_index.hpp"
 #include "spring.hpp"
+#include "spring_store.hpp"
+#include "stats.hpp"
+#include "sweep_and_prune.hpp"
+#include "thread_pool.hpp"
+#include "tracer.hpp"
+#include "trajectory.hpp"
+#include "union_find.hpp"
 
 #endif // cpparticles_hpp
@@ -4,9 +4,112 @@
 #define _USE_MATH_DEFINES
 
 #include <math.h>
-#include <random>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "checkpoint.hpp"
+#include "events.hpp"
+#include "grid.hpp"
+#include "handle_view.hpp"
+#include "kernels.hpp"
 #include "particle.hpp"
+#include "particle_store.hpp"
+#include "quadtree.hpp"
+#include "random.hpp"
+#include "render.hpp"
+#include "snapshot.hpp"
+#include "spatial_index.hpp"
 #include "spring.hpp"
+#include "spring_store.hpp"
+#include "stats.hpp"
+#include "sweep_and_prune.hpp"
+#include "thread_pool.hpp"
+#include "trajectory.hpp"
+#include "tracer.hpp"
+#include "union_find.hpp"
+
+
+// Method used to sum the attraction between particles.
+enum Attraction {
+	ALL_PAIRS,	// Attracts every pair of particles directly. Kept as the reference for the other methods.
+	BARNES_HUT	// Attracts each particle to the nearby particles and the centres of mass of distant groups in a quadtree.
+};
+
+
+// Method used to find the pairs of particles that may be in contact when colliding and combining.
+enum Broadphase {
+	BRUTE_FORCE,	// Tests every pair of particles. Kept as the reference for the other methods.
+	UNIFORM_GRID,	// Only tests pairs in the same or neighbouring cells of a grid rebuilt every update.
+	SWEEP_AND_PRUNE	// Only tests pairs whose bounding boxes overlap, found from boxes kept sorted between updates.
+};
+
+
+// Method used to advance the particles through each step.
+enum Integrator {
+	EXPLICIT_EULER,			// Moves each particle by its velocity at the start of the step, then accelerates it.
+	SEMI_IMPLICIT_EULER,	// Accelerates each particle, then moves it by its new velocity.
+	VELOCITY_VERLET			// Moves each particle by its velocity and half its acceleration, with velocities kept in step.
+};
+
+
+// Method used to update the springs.
+enum SpringSolver {
+	SPRING_FORCES,		// Accelerates the ends of each spring by its force. Stiff springs need small steps to stay stable.
+	SPRING_CONSTRAINTS	// Moves the ends of each spring towards its length, which stays stable however stiff the spring.
+};
+
+
+// Arrangement of the particles of a lattice added by addLattice.
+enum LatticeShape {
+	LATTICE_GRID,		// Rows of particles in columns, each square braced by both of its diagonals.
+	LATTICE_TRIANGLE,	// Rows of particles, every other row offset by half the spacing, joined into triangles.
+	LATTICE_RING		// Rings of particles around a centre, joined around each ring and to the next ring out.
+};
+
+
+// Ranges the attributes of particles added together by addParticles are drawn from. Each attribute is drawn
+// uniformly from its range. The defaults match the particles made by addParticle().
+struct ParticleDistribution {
+	float left = 0;				// Region the particles are placed in. Particles are kept a size's width inside it.
+	float top = 0;
+	float right = -1;			// A negative right or bottom extends the region to the edge of the environment.
+	float bottom = -1;
+	float minSize = 10;
+	float maxSize = 20;
+	float minMass = 100;
+	float maxMass = 10000;
+	float minSpeed = 0;
+	float maxSpeed = 1;
+	float minAngle = 0;
+	float maxAngle = 2 * M_PI;
+	float minElasticity = 0.8;
+	float maxElasticity = 1;
+	std::function<float(float mass)> size;	// If set, gives each particle's size from its mass instead of drawing it.
+	bool rejectOverlaps = false;	// Whether to keep placing particles until they do not overlap any others.
+	int maxAttempts = 30;		// Placements tried for each particle before it is left out.
+};
+
+
+// Layout of a lattice of particles joined by springs, added together by addLattice. Every particle of the lattice has
+// the same attributes, and each spring's length is the distance between its particles as they are placed.
+struct LatticeLayout {
+	LatticeShape shape = LATTICE_GRID;
+	float x = 0;			// Position of the first particle of a grid or triangle lattice, or the centre of a ring.
+	float y = 0;
+	int columns = 10;		// Particles in each row, or around each ring.
+	int rows = 10;			// Rows of particles, or rings.
+	float spacing = 20;		// Distance between neighbouring particles in a row, and between rings.
+	float radius = 50;		// Radius of the innermost ring.
+	float size = 5;
+	float mass = 100;
+	float elasticity = 0.9;
+	float strength = 0.5;
+};
 
 
 // Handles all interaction between particles, springs and attributes within the environment.
@@ -14,18 +117,42 @@ class Environment {
 public:
 	Environment(int width, int height);
 	~Environment();
+	int getAwakeCount() { return particles.getAwakeCount(); }
+	EventSpan<ContactEvent> getContactEvents() { return EventSpan<ContactEvent>(contactEvents.data(), contactEvents.size()); }
 	int getHeight() { return height; }
+	EventSpan<MergeEvent> getMergeEvents() { return EventSpan<MergeEvent>(mergeEvents.data(), mergeEvents.size()); }
 	int getWidth() { return width; }
-	Particle * addParticle();
-	Particle * addParticle(float x, float y, float size=10, float mass=100, float speed=0, float angle=0, float elasticity=0.9);
-	Particle * getParticle(float x, float y);
-	Spring * addSpring(Particle *p1, Particle *p2, float length=50, float strength=0.5);
-	std::vector<Particle* > getParticles() { return particles; }
-	std::vector<Spring* > getSprings() { return springs; }
-	void bounce(Particle *particle);
-	void removeParticle(Particle *particle);
-	void removeSpring(Spring *spring);
+	long getPairTests() { return pairTests; }
+	Attraction getAttraction() { return attraction; }
+	Broadphase getBroadphase() { return broadphase; }
+	Integrator getIntegrator() { return integrator; }
+	SimdLevel getSimdLevel() { return simdLevel; }
+	SpringSolver getSpringSolver() { return springSolver; }
+	Snapshot const& getSnapshot() { return snapshots.acquire(); }
+	StepStats const& getStats() { return stats; }
+	long getStepCount() { return steps; }
+	int getThreadCount() { return pool ? pool->getCount() : 1; }
+	Particle addParticle();
+	Particle addParticle(float x, float y, float size=10, float mass=100, float speed=0, float angle=0, float elasticity=0.9);
+	int addLattice(LatticeLayout const& layout, Particle *results=nullptr);
+	int addParticles(int count, ParticleDistribution const& distribution, uint64_t seed);
+	Particle getParticle(float x, float y);
+	int getNearestParticles(float x, float y, int k, Particle *results);
+	int getParticlesInBox(float left, float top, float right, float bottom, Particle *results, int capacity);
+	int getParticlesInRadius(float x, float y, float radius, Particle *results, int capacity);
+	Spring addSpring(Particle p1, Particle p2, float length=50, float strength=0.5);
+	ParticleView getParticles() { return ParticleView(&particles); }
+	SpringView getSprings() { return SpringView(&springs); }
+	int exportParticles(float *buffer, int capacity);
+	void extractRender(RenderView view, RenderBatch &batch);
+	bool isAsleep(Particle particle) { return particle.getIndex() >= particles.getAwakeCount(); }
+	void bounce(Particle particle);
+	void removeParticle(Particle particle);
+	void removeSpring(Spring spring);
+	static std::unique_ptr<Environment> loadCheckpoint(const char *path);
+	bool saveCheckpoint(const char *path);
 	void setAirMass(float a) { airMass = a; }
+	void setAttraction(Attraction a) { attraction = a; }
 	void setAllowAccelerate(bool setting) { allowAccelerate = setting; }
 	void setAllowAttract(bool setting) { allowAttract = setting; }
 	void setAllowBounce(bool setting) { allowBounce = setting; }
@@ -33,10 +160,74 @@ public:
 	void setAllowCombine(bool setting) { allowCombine = setting; }
 	void setAllowDrag(bool setting) { allowDrag = setting; }
 	void setAllowMove(bool setting) { allowMove = setting; }
+	void setAllowSleep(bool setting);
+	void setBroadphase(Broadphase b) { broadphase = b; }
+	void setCollectStats(bool setting) { collectStats = setting; }
+	void setCourantNumber(float c) { courantNumber = c; }
 	void setElasticity(float e) { elasticity = e; }
-	void update();
+	void setIntegrator(Integrator i) { integrator = i; }
+	void setMaxSubsteps(int s) { maxSubsteps = s; }
+	void setMergeSize(std::function<float(float mass)> rule) { mergeSize = rule; }
+	void setOpeningAngle(float theta) { openingAngle = theta; }
+	void setSeed(uint64_t seed) { random = Random(seed); }
+	void setPublishSnapshots(bool setting);
+	void setRecordEvents(bool setting) { recordEvents = setting; }
+	void setRecorder(TrajectoryRecorder *r) { recorder = r; }
+	void setSimdLevel(SimdLevel level);
+	void setSleepSpeed(float s) { sleepSpeed = s; }
+	void setSleepSteps(int s) { sleepSteps = s; }
+	void setSoftening(float s) { softening = s; }
+	void setSpringCompliance(float c) { springCompliance = c; }
+	void setSpringIterations(int i) { springIterations = i; }
+	void setSpringSolver(SpringSolver s) { springSolver = s; }
+	void setStatsCallback(std::function<void(StepStats const& stats)> callback) { statsCallback = callback; }
+	void setThreadCount(int count);
+	std::future<void> stepAsync(float dt=1);
+	void update(float dt=1);
+	void wake(Particle particle);
 	
 protected:
+	// Change to a particle's velocity and position from one contact, recorded by the threaded update.
+	struct Impulse {
+		int index;
+		float dvx;
+		float dvy;
+		float dx;
+		float dy;
+	};
+	// Sums of the attributes of a group of particles being merged.
+	struct MergeTotal {
+		double mass;
+		double x;
+		double y;
+		double vx;
+		double vy;
+		int survivor;
+	};
+	void attractParticles();
+	void beginForces();
+	bool collidePair(int i, int j, int awake);
+	void collideParallel();
+	bool collideSleeping(int i, int j);
+	template <Broadphase B>
+	void collideTask(int task, int worker, int count, int awake);
+	int countSubsteps(float dt);
+	void endForces(float dt);
+	void findOverlaps();
+	template <Broadphase B>
+	void findOverlapsTask(int task, int worker, int count, int awake);
+	template <typename Function>
+	void forEachInColor(int color, Function const& function);
+	void lap(Phase phase, std::chrono::steady_clock::time_point &start);
+	void mergeParticles();
+	void projectSprings(float dt);
+	void publishSnapshot();
+	void refreshIndex();
+	void resolveContacts();
+	void runSteps();
+	void step(float dt, std::chrono::steady_clock::time_point &lapStart);
+	void updateSleep();
+	void wakeIslands();
 	const int height;
 	const int width;
 	bool allowAccelerate = true;
@@ -46,10 +237,74 @@ protected:
 	bool allowCombine = false;
 	bool allowDrag = true;
 	bool allowMove = true;
+	bool allowSleep = false;
+	bool collectStats = false;
+	bool publishSnapshots = false;
+	bool recordEvents = false;
 	float airMass = 0.2;
+	float courantNumber = 0.5;
 	float elasticity = 0.75;
-	std::vector<Particle *> particles;
-	std::vector<Spring *> springs;
+	float openingAngle = 0.5;
+	float sleepSpeed = 0.5;
+	float softening = 0;
+	float springCompliance = 1;
+	int maxSubsteps = 1;
+	int sleepSteps = 60;
+	int springIterations = 2;
+	long steps = 0;
+	long pairTests = 0;
+	long collisions = 0;
+	Attraction attraction = ALL_PAIRS;
+	Broadphase broadphase = BRUTE_FORCE;
+	Integrator integrator = SEMI_IMPLICIT_EULER;
+	SpringSolver springSolver = SPRING_FORCES;
+	SimdLevel simdLevel = detectSimdLevel();
+	Random random;
+	TrajectoryRecorder *recorder = nullptr;
+	QuadTree quadTree;
+	UniformGrid grid;
+	SweepAndPrune sweepAndPrune;
+	SpatialIndex spatialIndex;
+	bool indexBuilt = false;
+	bool indexMoved = false;
+	std::vector<float> nearestDistances;
+	AlignedVector<int> candidates;
+	std::function<float(float)> mergeSize;
+	AlignedVector<MergeTotal> mergeTotals;
+	AlignedVector<bool> merging;
+	AlignedVector<SlotId> absorbed;
+	AlignedVector<std::pair<int, int> > overlaps;
+	AlignedVector<AlignedVector<std::pair<int, int> > > taskOverlaps;
+	UnionFind groups;
+	AlignedVector<float> springLambdas;
+	AlignedVector<float> forceVxs;
+	AlignedVector<float> forceVys;
+	AlignedVector<float> stepDrags;
+	AlignedVector<std::pair<SlotId, SlotId> > contacts;
+	AlignedVector<ContactEvent> contactEvents;
+	AlignedVector<MergeEvent> mergeEvents;
+	AlignedVector<AlignedVector<ContactEvent> > taskContactEvents;
+	AlignedVector<int> islandStill;
+	AlignedVector<bool> wakingIslands;
+	AlignedVector<int> falling;
+	std::unique_ptr<ThreadPool> pool;
+	AlignedVector<int> impulseCounts;
+	AlignedVector<Impulse> impulseTotals;
+	AlignedVector<AlignedVector<Impulse> > taskImpulses;
+	AlignedVector<long> taskPairTests;
+	AlignedVector<AlignedVector<int> > workerCandidates;
+	StepStats stats;
+	std::function<void(StepStats const&)> statsCallback;
+	TripleBuffer<Snapshot> snapshots;
+	std::thread stepThread;
+	std::mutex stepMutex;
+	std::condition_variable stepChanged;
+	std::promise<void> stepPromise;
+	bool stepRequested = false;
+	float stepDt = 1;
+	bool stopping = false;
+	ParticleStore particles;
+	SpringStore springs;
 	Vector acceleration = {M_PI, 0.2};
 };
 
@@ -0,0 +1,44 @@
+// Header for the ContactEvent and MergeEvent structs and the EventSpan class.
+#ifndef events_hpp
+#define events_hpp
+
+#include "particle.hpp"
+
+
+// Contact between two particles during an update, recorded when the environment records events. Either particle may
+// have been absorbed by a merge later in the same update.
+struct ContactEvent {
+	Particle p1;
+	Particle p2;
+	float impulseX;		// Change in the momentum of p1 from the contact. p2's change is the opposite.
+	float impulseY;
+	float x;			// Point of contact, where the line between the centres crosses the surfaces, at the start of
+	float y;			// the contact.
+};
+
+
+// Particle absorbed into another during an update, recorded when the environment records events. The absorbed
+// particle has been removed, so its handle converts to false, but still compares equal to other handles to it.
+struct MergeEvent {
+	Particle survivor;
+	Particle absorbed;
+};
+
+
+// Non-owning view of a contiguous array of events, which stays valid until the next update begins.
+template <typename Event>
+class EventSpan {
+public:
+	EventSpan(Event const *data, int count): data(data), count(count) {}
+	Event const *begin() const { return data; }
+	Event const *end() const { return data + count; }
+	Event const& operator[](int index) const { return data[index]; }
+	bool empty() const { return count == 0; }
+	int size() const { return count; }
+
+protected:
+	Event const *data;
+	int count;
+};
+
+#endif // events_hpp
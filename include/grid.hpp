@@ -0,0 +1,32 @@
+// Header for the UniformGrid class.
+#ifndef grid_hpp
+#define grid_hpp
+
+#include "aligned_vector.hpp"
+#include "particle_store.hpp"
+
+
+// Buckets particles into square cells so that only particles in neighbouring cells are tested against each other.
+class UniformGrid {
+public:
+	void build(ParticleStore const& particles);
+	int getCell(int index) { return cells[index]; }
+	void neighbours(int index, int after, AlignedVector<int> &result) const;
+	void update(int index, float x, float y);
+
+protected:
+	int cellOf(float x, float y);
+	void link(int index, int cell);
+	void unlink(int index);
+	float cellSize = 1;
+	float minX = 0;
+	float minY = 0;
+	int columns = 1;
+	int rows = 1;
+	AlignedVector<int> heads;
+	AlignedVector<int> next;
+	AlignedVector<int> prev;
+	AlignedVector<int> cells;
+};
+
+#endif // grid_hpp
@@ -0,0 +1,64 @@
+// Header for the HandleView class.
+#ifndef handle_view_hpp
+#define handle_view_hpp
+
+#include <iterator>
+#include "particle.hpp"
+#include "particle_store.hpp"
+#include "spring.hpp"
+#include "spring_store.hpp"
+
+
+// Non-owning view of every particle or spring in a store, handing out handles by dense index as it is iterated.
+// Nothing is copied, so a view costs no more than a pointer. The view sees changes to the store as they are made, so
+// adding or removing while iterating skips or repeats elements.
+template <typename Handle, typename Store>
+class HandleView {
+public:
+	// Iterates over the handles in dense index order.
+	class Iterator {
+	public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef Handle value_type;
+		typedef int difference_type;
+		typedef Handle const* pointer;
+		typedef Handle reference;
+		Iterator(Store *store, int index): store(store), index(index) {}
+		Handle operator*() const { return Handle(store, index); }
+		Handle operator[](int offset) const { return Handle(store, index + offset); }
+		Iterator& operator++() { index++; return *this; }
+		Iterator operator++(int) { Iterator old = *this; index++; return old; }
+		Iterator& operator--() { index--; return *this; }
+		Iterator operator--(int) { Iterator old = *this; index--; return old; }
+		Iterator& operator+=(int offset) { index += offset; return *this; }
+		Iterator& operator-=(int offset) { index -= offset; return *this; }
+		Iterator operator+(int offset) const { return Iterator(store, index + offset); }
+		Iterator operator-(int offset) const { return Iterator(store, index - offset); }
+		int operator-(Iterator const& other) const { return index - other.index; }
+		bool operator==(Iterator const& other) const { return index == other.index; }
+		bool operator!=(Iterator const& other) const { return index != other.index; }
+		bool operator<(Iterator const& other) const { return index < other.index; }
+		bool operator>(Iterator const& other) const { return index > other.index; }
+		bool operator<=(Iterator const& other) const { return index <= other.index; }
+		bool operator>=(Iterator const& other) const { return index >= other.index; }
+
+	protected:
+		Store *store;
+		int index;
+	};
+	HandleView(Store *store): store(store) {}
+	Iterator begin() const { return Iterator(store, 0); }
+	Iterator end() const { return Iterator(store, size()); }
+	bool empty() const { return size() == 0; }
+	int size() const { return store->getCount(); }
+	Handle operator[](int index) const { return Handle(store, index); }
+
+protected:
+	Store *store;
+};
+
+
+typedef HandleView<Particle, ParticleStore> ParticleView;
+typedef HandleView<Spring, SpringStore> SpringView;
+
+#endif // handle_view_hpp
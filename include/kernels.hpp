@@ -0,0 +1,52 @@
+// Header for the batch particle kernels.
+#ifndef kernels_hpp
+#define kernels_hpp
+
+#include "particle_store.hpp"
+
+
+// Instruction sets the batch kernels can use, from narrowest to widest.
+enum SimdLevel {
+	SIMD_SCALAR,	// One particle at a time. Used on every platform and for the particles left over by the others.
+	SIMD_SSE,	// 4 particles per instruction.
+	SIMD_AVX2,	// 8 particles per instruction.
+	SIMD_AVX512	// 16 particles per instruction.
+};
+
+
+// Bits of the feature set a kernel is compiled for, one for each per-particle stage.
+enum IntegrationFeature {
+	INTEGRATE_ACCELERATE = 1,	// Adds the environment's acceleration to the velocity.
+	INTEGRATE_MOVE = 2,		// Adds the velocity to the position.
+	INTEGRATE_DRAG = 4,		// Multiplies the velocity by the particle's drag.
+	INTEGRATE_BOUNCE = 8,		// Reflects particles off the edges of the environment.
+	INTEGRATE_SPLIT = 16,		// Adds the late part of the acceleration to the velocity after moving.
+	INTEGRATE_ALL = 31		// Every stage.
+};
+
+
+// Per-particle stages applied by integrateParticles, and the values they use.
+struct Integration {
+	bool accelerate;
+	bool move;
+	bool drag;
+	bool bounce;
+	bool split;
+	float ax;				// Velocity added before moving.
+	float ay;
+	float lateAx;			// Velocity added after moving, by integrators that split the acceleration around the move.
+	float lateAy;
+	float dt;				// Length of the step, by which the velocity is multiplied when moving.
+	const float *drags;		// Drag of each particle over the step, by particle index.
+	float width;
+	float height;
+};
+
+// Integrates the particles from begin to end with the stages and instruction set it was compiled for.
+typedef void (*IntegrationKernel)(ParticleStore &particles, int begin, int end, Integration const& integration);
+
+SimdLevel detectSimdLevel();
+IntegrationKernel selectIntegrationKernel(Integration const& integration, SimdLevel level);
+void integrateParticles(ParticleStore &particles, int begin, int end, Integration const& integration, SimdLevel level);
+
+#endif // kernels_hpp
@@ -4,9 +4,14 @@
 #define _USE_MATH_DEFINES
 
 #include <math.h>
+#include "particle_store.hpp"
+
+// Scales the attraction between the masses of two particles.
+const float GRAVITATIONAL_CONSTANT = 0.2;
 
 
 // Contains direction (angle) and magnitude (speed).
+// An angle of 0 points up the screen (negative y), and angles increase clockwise.
 struct Vector {
 	float angle;
 	float speed;
@@ -15,45 +20,67 @@ struct Vector {
 Vector operator+(Vector const& v1, Vector const& v2);
 
 
+// Result of a collision between two particles: their new velocities, and how far the first particle is pushed away
+// from the second. The second particle is pushed the same distance in the opposite direction.
+struct Collision {
+	float vx1;
+	float vy1;
+	float vx2;
+	float vy2;
+	float dx;
+	float dy;
+};
+
+
 // Handles the movement and forces acting upon the particle and surrounding particles.
+// A particle is a lightweight handle to its attributes in a ParticleStore, and is cheap to copy and pass by value.
+// Handles stay valid while other particles are added and removed. Once the particle itself is removed its handles
+// convert to false, and must not be used for anything else.
+// Velocity is stored as x and y components; its angle and speed are calculated when requested. A particle at rest
+// has no direction, so setting its speed moves it at an angle of 0.
 class Particle {
 public:
-	Particle(float x, float y, float size, float mass, float speed, float angle, float elasticity, float drag);
-	Particle *getCollideWith() { return collideWith; }
-	float getAngle() { return angle; }
-	float getDrag() { return drag; }
-	float getElasticity() { return elasticity; }
-	float getMass() { return mass; }
-	float getSize() { return size; }
-	float getSpeed() { return speed; }
-	float getX() { return x; }
-	float getY() { return y; }
+	Particle() {}
+	Particle(ParticleStore *store, int index);
+	Particle(ParticleStore *store, SlotId id);
+	explicit operator bool() const { return store != nullptr && store->ids.isLive(id); }
+	bool operator==(Particle const& other) const { return store == other.store && id.slot == other.id.slot && id.generation == other.id.generation; }
+	bool operator!=(Particle const& other) const { return !(*this == other); }
+	Particle getCollideWith();
+	bool getCollision(Particle otherP, Collision &collision);
+	float getAngle();
+	float getDrag() { return store->drags[getIndex()]; }
+	float getElasticity() { return store->elasticities[getIndex()]; }
+	SlotId getId() { return id; }
+	int getIndex() { return store->ids.getIndex(id.slot); }
+	float getMass() { return store->masses[getIndex()]; }
+	float getSize() { return store->sizes[getIndex()]; }
+	float getSpeed() { return hypot(store->vxs[getIndex()], store->vys[getIndex()]); }
+	float getVelocityX() { return store->vxs[getIndex()]; }
+	float getVelocityY() { return store->vys[getIndex()]; }
+	float getX() { return store->xs[getIndex()]; }
+	float getY() { return store->ys[getIndex()]; }
 	void accelerate(Vector vector);
-	void attract(Particle *otherP);
-	void collide(Particle *otherP);
-	void combine(Particle *otherP);
+	void accelerate(float ax, float ay) { int i = getIndex(); store->vxs[i] += ax; store->vys[i] += ay; }
+	void attract(Particle otherP);
+	bool collide(Particle otherP);
+	void combine(Particle otherP);
 	void experienceDrag();
 	void move();
 	void moveTo(float moveX, float moveY);
-	void setAngle(float a) { angle = a; }
-	void setDrag(float d) { drag = d; }
-	void setElasticity(float e) { elasticity = e; }
-	void setMass(float m) { mass = m; }
-	void setSize(float s) { size = s; }
-	void setSpeed(float s) { speed = s; }
-	void setX(float xCoord) { x = xCoord; }
-	void setY(float yCoord) { y = yCoord; }
+	void setAngle(float a);
+	void setDrag(float d) { store->drags[getIndex()] = d; }
+	void setElasticity(float e) { store->elasticities[getIndex()] = e; }
+	void setMass(float m) { store->masses[getIndex()] = m; }
+	void setSize(float s) { store->sizes[getIndex()] = s; }
+	void setSpeed(float s);
+	void setVelocity(float vx, float vy) { int i = getIndex(); store->vxs[i] = vx; store->vys[i] = vy; }
+	void setX(float xCoord) { store->xs[getIndex()] = xCoord; }
+	void setY(float yCoord) { store->ys[getIndex()] = yCoord; }
 	
 protected:
-	float angle;
-	float drag;
-	float elasticity;
-	float mass;
-	float size;
-	float speed;
-	float x;
-	float y;
-	Particle *collideWith = NULL;
+	ParticleStore *store = nullptr;
+	SlotId id = {-1, 0};
 };
 
 #endif // particle_hpp
@@ -0,0 +1,48 @@
+// Header for the ParticleStore class.
+#ifndef particle_store_hpp
+#define particle_store_hpp
+
+#include <vector>
+#include "aligned_vector.hpp"
+#include "slot_map.hpp"
+
+
+// Stores the attributes of every particle in an environment as contiguous arrays, one array per attribute.
+// Particle i is made up of the ith element of each array. Removing a particle moves the last particle into its place;
+// the slot map keeps track of where each particle has moved to.
+// The awake particles are kept in front of the sleeping ones, so that the particles from 0 to getAwakeCount() - 1 are
+// awake and the rest are asleep. New particles are awake.
+class ParticleStore {
+public:
+	int add(float x, float y, float size, float mass, float vx, float vy, float elasticity, float drag);
+	void clear();
+	int getAwakeCount() { return awake; }
+	int getCount() { return xs.size(); }
+	int grow(int count);
+	void remove(int index);
+	void reserve(int count);
+	int sleep(int index);
+	void swap(int a, int b);
+	int wake(int index);
+	void wakeAll() { awake = xs.size(); }
+
+	AlignedVector<float> deferredVxs;	// Change in velocity from forces that the integrator holds back until the next update.
+	AlignedVector<float> deferredVys;
+	AlignedVector<float> drags;
+	AlignedVector<float> elasticities;
+	AlignedVector<float> masses;
+	AlignedVector<float> sizes;
+	AlignedVector<float> vxs;
+	AlignedVector<float> vys;
+	AlignedVector<float> xs;
+	AlignedVector<float> ys;
+	AlignedVector<int> islands;	// Island each sleeping particle went to sleep with.
+	AlignedVector<int> stillSteps;	// Updates each awake particle has been slower than the sleep speed for.
+	std::vector<SlotId> collideWith;
+	SlotMap ids;
+
+protected:
+	int awake = 0;
+};
+
+#endif // particle_store_hpp
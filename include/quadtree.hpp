@@ -0,0 +1,37 @@
+// Header for the QuadTree class.
+#ifndef quadtree_hpp
+#define quadtree_hpp
+
+#include "aligned_vector.hpp"
+#include "particle_store.hpp"
+
+
+// Groups particles into a Barnes-Hut quadtree so that distant groups of particles attract as a single mass.
+class QuadTree {
+public:
+	void build(ParticleStore const& particles, float minX, float minY, float maxX, float maxY);
+	void getAcceleration(int index, float theta, float softening, float &ax, float &ay) const;
+
+protected:
+	// A square region of the tree. Leaves hold a list of particles, other nodes hold four children.
+	struct Node {
+		float centreX;
+		float centreY;
+		float half;
+		float mass = 0;
+		float massX = 0;
+		float massY = 0;
+		int children = -1;
+		int first = -1;
+	};
+	int addNode(float centreX, float centreY, float half);
+	void insert(int index);
+	void sumMass(int node);
+	AlignedVector<Node> nodes;
+	AlignedVector<float> xs;
+	AlignedVector<float> ys;
+	AlignedVector<float> masses;
+	AlignedVector<int> next;
+};
+
+#endif // quadtree_hpp
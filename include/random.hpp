@@ -0,0 +1,30 @@
+// Header for the Random class.
+#ifndef random_hpp
+#define random_hpp
+
+#include <cstdint>
+
+
+// Fast seedable random number generator (SplitMix64). Generators made with the same seed but different streams give
+// independent sequences, so work split between threads can give every item its own stream and draw the same numbers
+// however the work is split.
+class Random {
+public:
+	Random(uint64_t seed=0, uint64_t stream=0): state(mix(seed + mix(stream + GOLDEN))) {}
+	uint64_t next() { return mix(state += GOLDEN); }
+	// Returns a number from min up to, but not including, max.
+	float uniform(float min, float max) { return min + (next() >> 40) * (1.0f / 16777216) * (max - min); }
+	// Returns a whole number from min to max inclusive.
+	int uniformInt(int min, int max) { return min + static_cast<int>(((next() >> 32) * (uint64_t)(max - min + 1)) >> 32); }
+
+protected:
+	static const uint64_t GOLDEN = 0x9E3779B97F4A7C15ull;
+	static uint64_t mix(uint64_t z) {
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+	uint64_t state;
+};
+
+#endif // random_hpp
@@ -0,0 +1,40 @@
+// Header for the RenderView and RenderBatch structs.
+#ifndef render_hpp
+#define render_hpp
+
+#include "aligned_vector.hpp"
+#include "snapshot.hpp"
+
+
+// Part of the environment to draw and how it is drawn, for extractRender. Positions are mapped to the target by
+// moving the corner of the view to the corner of the target, and scaling by the zoom.
+struct RenderView {
+	float left = 0;				// Point of the environment drawn at the top left corner of the target.
+	float top = 0;
+	float zoom = 1;				// Pixels of the target per unit of distance in the environment.
+	float width = -1;			// Size of the target in pixels. A negative size is replaced by the size of the
+	float height = -1;			// environment.
+	bool velocities = false;	// Whether each particle instance also holds the particle's velocity.
+	bool masses = false;		// Whether each particle instance also holds the particle's mass.
+	bool springs = true;		// Whether to extract the springs.
+};
+
+
+// Buffers of the particles and springs visible in a view, in the coordinates of the target, ready to upload as
+// instance and vertex buffers. The buffers are kept between calls, so extracting allocates nothing once they have
+// grown to fit.
+struct RenderBatch {
+	long step = 0;							// Update the snapshot extracted from was published after.
+	int stride = 3;							// Floats in each particle instance.
+	int particleCount = 0;
+	int springCount = 0;
+	AlignedVector<float> particles;			// Instances as (x, y, radius), followed by (vx, vy) and then mass when
+											// the view asks for them.
+	AlignedVector<int> indices;				// Index of each instance's particle in the snapshot.
+	AlignedVector<float> springs;			// Line segments as (x1, y1, x2, y2).
+};
+
+
+void extractRender(Snapshot const& snapshot, RenderView const& view, RenderBatch &batch);
+
+#endif // render_hpp
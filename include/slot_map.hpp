@@ -0,0 +1,47 @@
+// Header for the SlotMap class and SlotId struct.
+#ifndef slot_map_hpp
+#define slot_map_hpp
+
+#include <vector>
+
+
+// Identifies an element of a SlotMap. The generation tells apart the elements that have used the same slot.
+struct SlotId {
+	int slot;
+	int generation;
+};
+
+
+// Maps stable slots to the positions (indices) of elements in densely packed arrays. Removing an element moves the
+// last element into its place, and frees its slot for reuse by a later element with a new generation.
+class SlotMap {
+public:
+	int add();
+	void clear();
+	int getCount() const { return slots.size(); }
+	int getGeneration(int slot) const { return generations[slot]; }
+	SlotId getId(int index) const { return SlotId{slots[index], generations[slots[index]]}; }
+	int getIndex(int slot) const { return indices[slot]; }
+	int getSlot(int index) const { return slots[index]; }
+	int getSlotCount() const { return generations.size(); }
+	bool isLive(SlotId id) const;
+	int remove(int slot);
+	void reserve(int count);
+	void swap(int a, int b);
+
+protected:
+	std::vector<int> freeSlots;
+	std::vector<int> generations;
+	std::vector<int> indices;
+	std::vector<int> slots;
+};
+
+
+// Moves the last element of an array to the index and shrinks the array by one, following a SlotMap::remove.
+template <typename T>
+void moveLast(T &array, int index) {
+	array[index] = array.back();
+	array.pop_back();
+}
+
+#endif // slot_map_hpp
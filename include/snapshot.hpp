@@ -0,0 +1,55 @@
+// Header for the Snapshot struct and TripleBuffer class.
+#ifndef snapshot_hpp
+#define snapshot_hpp
+
+#include <atomic>
+#include "aligned_vector.hpp"
+#include "slot_map.hpp"
+
+
+// Copy of the state of the particles and springs at the end of an update, for reading while the next update runs.
+// Particles are in dense index order, and springs refer to their particles by their index in the snapshot.
+struct Snapshot {
+	long step = 0;
+	AlignedVector<SlotId> ids;
+	AlignedVector<float> xs;
+	AlignedVector<float> ys;
+	AlignedVector<float> vxs;
+	AlignedVector<float> vys;
+	AlignedVector<float> sizes;
+	AlignedVector<float> masses;
+	AlignedVector<int> p1s;
+	AlignedVector<int> p2s;
+	AlignedVector<float> lengths;
+	AlignedVector<float> strengths;
+};
+
+
+// Passes values from one writer thread to one reader thread without locks. The writer fills the back buffer and
+// publishes it, and the reader acquires the most recently published buffer. Each side owns its buffer until it swaps
+// it with the shared middle buffer, so neither ever sees the other's buffer half written.
+template <typename T>
+class TripleBuffer {
+public:
+	// Returns the most recently published value. It stays valid and unchanged until the next call.
+	T const& acquire() {
+		if (middle.load(std::memory_order_relaxed) & FRESH) {
+			front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+		}
+		return buffers[front];
+	}
+	// Returns the buffer for the writer to fill before publishing it.
+	T& getBack() { return buffers[back]; }
+	// Makes the back buffer the latest value, and takes the buffer the reader is not using as the new back buffer.
+	void publish() { back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX; }
+
+protected:
+	static const int INDEX = 3;
+	static const int FRESH = 4;
+	T buffers[3];
+	std::atomic<int> middle{1};
+	int back = 0;
+	int front = 2;
+};
+
+#endif // snapshot_hpp
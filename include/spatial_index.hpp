@@ -0,0 +1,55 @@
+// Header for the SpatialIndex class.
+#ifndef spatial_index_hpp
+#define spatial_index_hpp
+
+#include <vector>
+#include "particle_store.hpp"
+
+
+// Buckets particles into the cells of a grid by their slot, so that they can be found by position. Unlike the
+// UniformGrid, the index is kept between updates and only particles which have changed cell are moved.
+class SpatialIndex {
+public:
+	void build(ParticleStore const& particles, float width, float height);
+	template <typename Visit> void forEachInBox(float left, float top, float right, float bottom, Visit visit) const;
+	float getMaxSize() const { return maxSize; }
+	void insert(int slot, float x, float y, float size);
+	void refresh(ParticleStore const& particles, float width, float height);
+	void remove(int slot);
+
+protected:
+	int cellOf(float x, float y) const;
+	void link(int slot, int cell);
+	void unlink(int slot);
+	float cellSize = 1;
+	float maxSize = 0;
+	float minX = 0;
+	float minY = 0;
+	float maxX = 0;
+	float maxY = 0;
+	int builtCount = 0;
+	int columns = 1;
+	int rows = 1;
+	std::vector<int> heads;
+	std::vector<int> next;
+	std::vector<int> prev;
+	std::vector<int> cells;
+};
+
+
+// Calls visit(slot) for every particle in the cells overlapping the box from (left, top) to (right, bottom). The
+// caller must check the particles' positions, as the cells may extend past the box.
+template <typename Visit>
+void SpatialIndex::forEachInBox(float left, float top, float right, float bottom, Visit visit) const {
+	int first = cellOf(left, top);
+	int last = cellOf(right, bottom);
+	for (int row = first / columns; row <= last / columns; row++) {
+		for (int column = first % columns; column <= last % columns; column++) {
+			for (int slot = heads[row * columns + column]; slot != -1; slot = next[slot]) {
+				visit(slot);
+			}
+		}
+	}
+}
+
+#endif // spatial_index_hpp
@@ -5,21 +5,33 @@
 
 #include <math.h>
 #include "particle.hpp"
+#include "spring_store.hpp"
 
 
 // Handles the movement and forces acting upon the spring.
+// Like a particle, a spring is a lightweight handle to its attributes in a SpringStore, and converts to false once
+// the spring has been removed. Removing either of its particles removes the spring.
 class Spring {
 public:
-	Spring(Particle *p1, Particle *p2, float length=50, float strength=0.5);
-	Particle *getP1() { return p1; }
-	Particle *getP2() { return p2; }
+	Spring() {}
+	Spring(SpringStore *store, int index);
+	Spring(SpringStore *store, SlotId id);
+	explicit operator bool() const { return store != nullptr && store->ids.isLive(id); }
+	bool operator==(Spring const& other) const { return store == other.store && id.slot == other.id.slot && id.generation == other.id.generation; }
+	bool operator!=(Spring const& other) const { return !(*this == other); }
+	SlotId getId() { return id; }
+	int getIndex() { return store->ids.getIndex(id.slot); }
+	float getLength() { return store->lengths[getIndex()]; }
+	float getStrength() { return store->strengths[getIndex()]; }
+	Particle getP1();
+	Particle getP2();
+	void setLength(float l) { store->lengths[getIndex()] = l; }
+	void setStrength(float s) { store->strengths[getIndex()] = s; }
 	void update();
 	
 protected:
-	float length;
-	float strength;
-	Particle *p1;
-	Particle *p2;
+	SpringStore *store = nullptr;
+	SlotId id = {-1, 0};
 };
 
 #endif // spring_hpp
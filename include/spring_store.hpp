@@ -0,0 +1,50 @@
+// Header for the SpringStore class.
+#ifndef spring_store_hpp
+#define spring_store_hpp
+
+#include <vector>
+#include "aligned_vector.hpp"
+#include "particle_store.hpp"
+#include "slot_map.hpp"
+
+
+// Stores the attributes of every spring in an environment as contiguous arrays, one array per attribute. The ends of
+// each spring are stored as the slots of its particles in the ParticleStore. Like the particles, removing a spring
+// moves the last spring into its place.
+// The springs attached to each particle are kept as one array, rebuilt when it is next needed after springs are added.
+// The springs can also be grouped into colors, no two springs of a color sharing a particle, so that the springs of
+// one color can be updated at the same time.
+class SpringStore {
+public:
+	SpringStore(ParticleStore *particles);
+	int add(int p1, int p2, float length, float strength);
+	void clear();
+	void color();
+	int getColorCount() { return colorOffsets.size() - 1; }
+	int getCount() { return p1s.size(); }
+	int grow(int count);
+	void remove(int index);
+	void removeAttached(int particle);
+	void reserve(int count);
+
+	ParticleStore *particles;
+	AlignedVector<float> lengths;
+	AlignedVector<float> strengths;
+	std::vector<int> p1s;
+	std::vector<int> p2s;
+	AlignedVector<int> colored;			// Indices of the springs grouped by color, as of the last call to color().
+	AlignedVector<int> colorOffsets;	// Start of each color in colored, followed by the number of springs.
+	SlotMap ids;
+
+protected:
+	void attach();
+	// Springs attached to each particle slot, from attachedOffsets[slot] up to attachedOffsets[slot + 1].
+	AlignedVector<int> attachedOffsets;
+	AlignedVector<SlotId> attachedSprings;
+	bool attachedCurrent = false;
+	bool colorsCurrent = false;
+	AlignedVector<int> colorStamps;
+	AlignedVector<int> uncolored;
+};
+
+#endif // spring_store_hpp
@@ -0,0 +1,36 @@
+// Header for the StepStats struct.
+#ifndef stats_hpp
+#define stats_hpp
+
+
+// Parts of an update that are timed separately. Particles are bounced off the boundary in the same pass that moves
+// them, so bouncing is timed as part of integration.
+enum Phase {
+	PHASE_INTEGRATE,	// Accelerating, dragging, moving and bouncing the particles.
+	PHASE_ATTRACT,		// Attracting the particles to each other.
+	PHASE_COLLIDE,		// Finding and resolving contacts between particles.
+	PHASE_COMBINE,		// Merging overlapping particles.
+	PHASE_SPRINGS,		// Updating the springs.
+	PHASE_SLEEP,		// Putting resting islands to sleep and waking disturbed ones.
+	PHASE_PUBLISH,		// Publishing the snapshot.
+	PHASE_RECORD,		// Recording the frame of the trajectory.
+	PHASE_COUNT
+};
+
+
+// Measurements of one update of an environment, collected when stats are turned on.
+struct StepStats {
+	long step = 0;						// Number of updates made, including this one.
+	int substeps = 0;					// Steps the update was divided into.
+	double seconds = 0;					// Wall time of the whole update.
+	double phaseSeconds[PHASE_COUNT] = {};	// Wall time of each phase. Phases that did not run take no time.
+	long pairTests = 0;					// Pairs of particles tested for contact, when colliding and combining.
+	long collisions = 0;				// Pairs of particles found in contact and collided.
+	long merges = 0;					// Particles absorbed into others when combining.
+	int particles = 0;					// Particles at the end of the update.
+	int springs = 0;					// Springs at the end of the update.
+	int sleeping = 0;					// Particles asleep at the end of the update.
+	long allocations = 0;				// Arrays allocated by the library during the update, on any thread.
+};
+
+#endif // stats_hpp
@@ -0,0 +1,38 @@
+// Header for the SweepAndPrune class.
+#ifndef sweep_and_prune_hpp
+#define sweep_and_prune_hpp
+
+#include <utility>
+#include "aligned_vector.hpp"
+#include "particle_store.hpp"
+
+
+// Finds the pairs of particles whose bounding boxes overlap, by sweeping the boxes in order of their left edges. The
+// order is kept from one update to the next, and particles move little between updates, so sorting it again takes
+// little more than one pass. Unlike a grid, the cost does not grow with the size of the largest particle.
+class SweepAndPrune {
+public:
+	int getNeighbourCount(int index) const { return offsets[index + 1] - offsets[index]; }
+	const int * getNeighbours(int index) const { return neighbours.data() + offsets[index]; }
+	void update(ParticleStore const& particles, int awake);
+
+protected:
+	// Bounding box of one particle.
+	struct Box {
+		float left;
+		float right;
+		float top;
+		float bottom;
+		int index;
+		SlotId id;
+	};
+	void sort(int added);
+	void sweep(int awake);
+	AlignedVector<Box> boxes;
+	AlignedVector<bool> listed;
+	AlignedVector<std::pair<int, int> > pairs;
+	AlignedVector<int> offsets;
+	AlignedVector<int> neighbours;
+};
+
+#endif // sweep_and_prune_hpp
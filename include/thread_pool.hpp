@@ -0,0 +1,43 @@
+// Header for the ThreadPool class.
+#ifndef thread_pool_hpp
+#define thread_pool_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Runs numbered tasks on a fixed set of worker threads. Each worker starts with an equal share of the tasks, and
+// steals tasks from the other workers once its own share is finished.
+class ThreadPool {
+public:
+	ThreadPool(int count);
+	~ThreadPool();
+	int getCount() { return count; }
+	void run(int tasks, std::function<void(int task, int worker)> const& function);
+
+protected:
+	// The tasks not yet claimed from a worker's share. Padded so that workers do not contend for a cache line.
+	struct alignas(64) Queue {
+		std::atomic<int> next;
+		int end;
+	};
+	void runTasks(int worker);
+	void work(int worker);
+	const int count;
+	std::unique_ptr<Queue[]> queues;
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable started;
+	std::condition_variable finished;
+	std::function<void(int, int)> const* function = nullptr;
+	int busy = 0;
+	int generation = 0;
+	bool stopping = false;
+};
+
+#endif // thread_pool_hpp
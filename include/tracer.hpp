@@ -0,0 +1,79 @@
+// Header for the Tracer and TraceScope classes.
+#ifndef tracer_hpp
+#define tracer_hpp
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Spans are only recorded by the macros below when the library is built with CPPARTICLES_TRACE defined. Otherwise
+// they expand to nothing, and the update is compiled exactly as it would be without a tracer.
+#ifdef CPPARTICLES_TRACE
+#define CPPARTICLES_TRACE_CONCAT_(a, b) a##b
+#define CPPARTICLES_TRACE_CONCAT(a, b) CPPARTICLES_TRACE_CONCAT_(a, b)
+#define CPPARTICLES_TRACE_SCOPE(name) TraceScope CPPARTICLES_TRACE_CONCAT(traceScope, __LINE__)(name)
+#define CPPARTICLES_TRACE_THREAD(name) Tracer::setThreadName(name)
+#else
+#define CPPARTICLES_TRACE_SCOPE(name)
+#define CPPARTICLES_TRACE_THREAD(name)
+#endif
+
+
+// Records timed spans from every thread into a ring buffer per thread, and writes them out in the Chrome trace event
+// format, which can be opened in Perfetto or chrome://tracing. Recording takes no locks: each thread only writes to
+// its own buffer, and a buffer is only locked when its thread records its first span. Once a buffer is full, the
+// oldest spans are overwritten.
+class Tracer {
+public:
+	static void clear();
+	static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+	static void record(const char *name, long long start, long long end);
+	static void setCapacity(int spans);
+	static void setEnabled(bool setting) { enabled.store(setting, std::memory_order_relaxed); }
+	static void setThreadName(std::string const& name);
+	static long long now();
+	static bool write(const char *path);
+	static void write(std::ostream &out);
+
+protected:
+	// One recorded span. Names are not copied, so they must be string literals.
+	struct Span {
+		const char *name;
+		long long start;
+		long long end;
+	};
+	// The spans recorded by one thread.
+	struct Ring {
+		std::unique_ptr<Span[]> spans;
+		int capacity;
+		int thread;
+		std::string name;
+		std::atomic<long long> count;
+	};
+	static Ring * getRing();
+	static std::atomic<bool> enabled;
+	static std::mutex ringsMutex;
+	static std::vector<std::unique_ptr<Ring> > rings;
+	static int ringCapacity;
+	static thread_local Ring *threadRing;
+	static thread_local std::string threadName;
+};
+
+
+// Records a span covering its own lifetime, if the tracer is enabled when it is constructed.
+class TraceScope {
+public:
+	TraceScope(const char *name): name(name), start(Tracer::isEnabled() ? Tracer::now() : -1) {}
+	~TraceScope() { if (start >= 0) Tracer::record(name, start, Tracer::now()); }
+	TraceScope(TraceScope const&) = delete;
+	TraceScope& operator=(TraceScope const&) = delete;
+
+protected:
+	const char *name;
+	long long start;
+};
+
+#endif // tracer_hpp
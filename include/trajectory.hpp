@@ -0,0 +1,97 @@
+// Header for the TrajectoryRecorder and TrajectoryReader classes.
+#ifndef trajectory_hpp
+#define trajectory_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "particle_store.hpp"
+#include "snapshot.hpp"
+
+// Version of the trajectory format written by this version of the library.
+const uint32_t TRAJECTORY_VERSION = 1;
+
+
+// Records the positions and sizes of the particles after every update to a file, for playing back without running the
+// physics. Values are quantized to a fixed step and stored as variable-length differences from the same particle in
+// the previous frame. Frames are grouped into chunks that each start with a keyframe, which stores the values
+// themselves, so a reader can start decoding at any chunk. Full chunks are written by a background thread, so the
+// update only waits to encode the frame, never for the disk.
+class TrajectoryRecorder {
+public:
+	TrajectoryRecorder() {}
+	~TrajectoryRecorder();
+	TrajectoryRecorder(TrajectoryRecorder const&) = delete;
+	TrajectoryRecorder& operator=(TrajectoryRecorder const&) = delete;
+	bool close();
+	long getFrameCount() { return frameCount; }
+	bool hasFailed() { return failed.load(); }
+	bool open(const char *path, float quantum=1.0f / 64, int keyframeInterval=60);
+	void record(long step, ParticleStore &particles);
+
+protected:
+	void startChunk();
+	void write();
+	FILE *file = nullptr;
+	float quantum = 1;
+	int keyframeInterval = 60;
+	long frameCount = 0;
+	long chunkFirstFrame = 0;
+	int chunkFrames = 0;
+	std::vector<unsigned char> chunk;
+	std::vector<int32_t> lastGenerations;
+	std::vector<int32_t> lastXs;
+	std::vector<int32_t> lastYs;
+	std::vector<int32_t> lastSizes;
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable queued;
+	std::deque<std::vector<unsigned char> > queue;
+	bool stopping = false;
+	std::atomic<bool> failed{false};
+};
+
+
+// Plays back a file written by a TrajectoryRecorder. Reading a frame decodes from the keyframe at the start of its
+// chunk, so any frame can be read in any order, and frames read in order only decode each frame once.
+class TrajectoryReader {
+public:
+	TrajectoryReader() {}
+	~TrajectoryReader();
+	TrajectoryReader(TrajectoryReader const&) = delete;
+	TrajectoryReader& operator=(TrajectoryReader const&) = delete;
+	void close();
+	long getFrameCount() { return frameCount; }
+	float getQuantum() { return quantum; }
+	bool open(const char *path);
+	bool readFrame(long frame, Snapshot &snapshot);
+
+protected:
+	// Where a chunk is in the file, and which frames it holds.
+	struct Chunk {
+		long firstFrame;
+		int frames;
+		long offset;
+		uint32_t size;
+	};
+	bool decodeFrame(Snapshot &snapshot);
+	FILE *file = nullptr;
+	float quantum = 1;
+	long frameCount = 0;
+	std::vector<Chunk> chunks;
+	int loadedChunk = -1;
+	long nextFrame = -1;
+	std::size_t position = 0;
+	std::vector<unsigned char> chunk;
+	std::vector<int32_t> lastGenerations;
+	std::vector<int32_t> lastXs;
+	std::vector<int32_t> lastYs;
+	std::vector<int32_t> lastSizes;
+};
+
+#endif // trajectory_hpp
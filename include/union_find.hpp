@@ -0,0 +1,20 @@
+// Header for the UnionFind class.
+#ifndef union_find_hpp
+#define union_find_hpp
+
+#include "aligned_vector.hpp"
+
+
+// Partitions the numbers from 0 to count - 1 into disjoint groups, which can be joined together.
+class UnionFind {
+public:
+	int find(int element);
+	void reset(int count);
+	void unite(int a, int b);
+
+protected:
+	AlignedVector<int> parents;
+	AlignedVector<int> sizes;
+};
+
+#endif // union_find_hpp
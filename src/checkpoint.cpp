@@ -0,0 +1,84 @@
+// Contains member functions of the MappedFile class.
+// Gives read-only access to a whole file, mapping it into memory where the system allows.
+#include <cstdio>
+#include "../include/checkpoint.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CPPARTICLES_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// MappedFile destructor.
+MappedFile::~MappedFile() {
+	close();
+}
+
+
+// Unmaps or frees the file's contents.
+void MappedFile::close() {
+	if (data) {
+#ifdef CPPARTICLES_MMAP
+		if (mapped) {
+			munmap(const_cast<unsigned char *>(data), size);
+		}
+#endif
+		if (!mapped) {
+			delete[] data;
+		}
+	}
+	data = nullptr;
+	size = 0;
+	mapped = false;
+}
+
+
+// Opens a file, returning whether its contents are available.
+bool MappedFile::open(const char *path) {
+	close();
+#ifdef CPPARTICLES_MMAP
+	int descriptor = ::open(path, O_RDONLY);
+	if (descriptor < 0) {
+		return false;
+	}
+	struct stat status;
+	if (fstat(descriptor, &status) != 0 || status.st_size <= 0) {
+		::close(descriptor);
+		return false;
+	}
+	void *address = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	::close(descriptor);
+	if (address == MAP_FAILED) {
+		return false;
+	}
+	data = static_cast<const unsigned char *>(address);
+	size = status.st_size;
+	mapped = true;
+	return true;
+#else
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (length <= 0) {
+		fclose(file);
+		return false;
+	}
+	unsigned char *buffer = new unsigned char[length];
+	bool read = fread(buffer, 1, length, file) == static_cast<std::size_t>(length);
+	fclose(file);
+	if (!read) {
+		delete[] buffer;
+		return false;
+	}
+	data = buffer;
+	size = length;
+	return true;
+#endif
+}
@@ -1,157 +1,1561 @@
 // Contains member functions of the Environment class.
 // Handles all interaction between particles, springs and attributes within the environment.
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <random>
 #include "../include/environment.hpp"
 
+// Number of particles integrated or attracted by each task of the threaded step. A multiple of the widest SIMD batch.
+static const int PARTICLE_CHUNK = 1024;
+// Number of particles whose contacts are found by each task of the threaded step. Kept small so that the workers can
+// balance crowded regions by stealing.
+static const int CONTACT_CHUNK = 128;
+// Number of springs of one color updated by each task of the threaded step.
+static const int SPRING_CHUNK = 1024;
+
 
 // Environment constructor.
 Environment::Environment(int width, int height):
-width(width), height(height) {
+width(width), height(height), random(std::random_device()()), springs(&particles) {
+	workerCandidates.resize(1);
 }
 
 
-// Environment destructor. Destroys all particles and springs in the environment.
+// Environment destructor. Waits for any step still running on the stepping thread.
 Environment::~Environment() {
-	for (int i = 0; i < springs.size(); i++) {
-		delete springs[i];
-	}
-	for (int i = 0; i < particles.size(); i++) {
-		delete particles[i];
-	}
-}
-
-
-// Adds a particle with randomly generated attributes to the environment and returns a pointer to the particle.
-Particle * Environment::addParticle() {
-	std::random_device rd;
-	std::mt19937 engine(rd());
-	std::uniform_int_distribution<int> sizeDist(10,20);
-	float size = sizeDist(rd);
-	std::uniform_int_distribution<int> massDist(100, 10000);
-	float mass = massDist(rd);
-	std::uniform_int_distribution<int> xDist(size, width - size);
-	float x = xDist(rd);
-	std::uniform_int_distribution<int> yDist(size, height - size);
-	float y = yDist(rd);
-	std::uniform_real_distribution<float> speedDist (0, 1);
-	float speed = speedDist(rd);
-	std::uniform_real_distribution<float> angleDist (0, 2 * M_PI);
-	float angle = angleDist(rd);
-	std::uniform_real_distribution<float> elasticityDist (0.8, 1);
-	float elasticity = elasticityDist(rd);
+	if (stepThread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(stepMutex);
+			stopping = true;
+		}
+		stepChanged.notify_all();
+		stepThread.join();
+	}
+}
+
+
+// Adds a particle with randomly generated attributes to the environment and returns the particle. The attributes are
+// drawn from the environment's generator, so the same seed gives the same particles.
+Particle Environment::addParticle() {
+	float size = random.uniformInt(10, 20);
+	float mass = random.uniformInt(100, 10000);
+	float x = random.uniformInt(size, width - size);
+	float y = random.uniformInt(size, height - size);
+	float speed = random.uniform(0, 1);
+	float angle = random.uniform(0, 2 * M_PI);
+	float elasticity = random.uniform(0.8, 1);
 	return addParticle(x, y, size, mass, speed, angle, elasticity);
 }
 
 
-// Adds a particle with parameter-specified attributes to the environment and returns a pointer to the particle.
-Particle * Environment::addParticle(float x, float y, float size, float mass, float speed, float angle, float elasticity) {
+// Adds a particle with parameter-specified attributes to the environment and returns the particle.
+Particle Environment::addParticle(float x, float y, float size, float mass, float speed, float angle, float elasticity) {
 	// Equation for drag [source]: http://www.petercollingridge.co.uk/tutorials/pygame-physics-simulation/mass/
 	float drag = pow((mass / (mass + airMass)), size);
-	Particle *particle = new Particle(x, y, size, mass, speed, angle, elasticity, drag);
-	particles.push_back(particle);
-	return particle;
+	int index = particles.add(x, y, size, mass, sin(angle) * speed, -cos(angle) * speed, elasticity, drag);
+	if (indexBuilt) {
+		spatialIndex.insert(particles.ids.getSlot(index), x, y, size);
+	}
+	return Particle(&particles, index);
+}
+
+
+// Adds a lattice of particles joined by springs, and returns how many particles were added. The particles and springs
+// are each added at once and filled in place. If results is given, it must have room for every particle of the
+// lattice, and is filled with them row by row, or ring by ring from the inside out.
+int Environment::addLattice(LatticeLayout const& layout, Particle *results) {
+	int columns = layout.columns;
+	int rows = layout.rows;
+	if (columns <= 0 || rows <= 0) {
+		return 0;
+	}
+	int count = columns * rows;
+	int first = particles.grow(count);
+	float drag = pow((layout.mass / (layout.mass + airMass)), layout.size);
+	float rowHeight = layout.shape == LATTICE_TRIANGLE ? layout.spacing * sqrt(3) / 2 : layout.spacing;
+	for (int r = 0; r < rows; r++) {
+		for (int c = 0; c < columns; c++) {
+			int i = first + r * columns + c;
+			if (layout.shape == LATTICE_RING) {
+				float radius = layout.radius + r * layout.spacing;
+				float angle = 2 * M_PI * c / columns;
+				particles.xs[i] = layout.x + radius * cos(angle);
+				particles.ys[i] = layout.y + radius * sin(angle);
+			} else {
+				float offset = layout.shape == LATTICE_TRIANGLE && r % 2 == 1 ? 0.5 : 0;
+				particles.xs[i] = layout.x + (c + offset) * layout.spacing;
+				particles.ys[i] = layout.y + r * rowHeight;
+			}
+			particles.sizes[i] = layout.size;
+			particles.masses[i] = layout.mass;
+			particles.elasticities[i] = layout.elasticity;
+			particles.drags[i] = drag;
+		}
+	}
+
+	// Visits each pair of particles joined by a spring, by their places in the lattice. The springs are counted on the
+	// first visit and filled in on the second.
+	auto forEachLink = [&](auto visit) {
+		for (int r = 0; r < rows; r++) {
+			for (int c = 0; c < columns; c++) {
+				int a = r * columns + c;
+				bool right = c + 1 < columns;
+				bool down = r + 1 < rows;
+				if (layout.shape == LATTICE_GRID) {
+					if (right) {
+						visit(a, a + 1);
+					}
+					if (down) {
+						visit(a, a + columns);
+					}
+					if (right && down) {
+						visit(a, a + columns + 1);
+						visit(a + 1, a + columns);
+					}
+				} else if (layout.shape == LATTICE_TRIANGLE) {
+					if (right) {
+						visit(a, a + 1);
+					}
+					// Odd rows are offset to the right, so their particles sit over the gaps in the rows either side.
+					if (down) {
+						visit(a, a + columns);
+						if (r % 2 == 0 && c > 0) {
+							visit(a, a + columns - 1);
+						} else if (r % 2 == 1 && right) {
+							visit(a, a + columns + 1);
+						}
+					}
+				} else {
+					int next = r * columns + (c + 1) % columns;
+					if (columns > 2 || right) {
+						visit(a, next);
+					}
+					if (down) {
+						visit(a, a + columns);
+						if (columns > 1) {
+							visit(a, next + columns);
+						}
+					}
+				}
+			}
+		}
+	};
+	int springCount = 0;
+	forEachLink([&](int, int) { springCount++; });
+	int spring = springs.grow(springCount);
+	forEachLink([&](int a, int b) {
+		springs.p1s[spring] = particles.ids.getSlot(first + a);
+		springs.p2s[spring] = particles.ids.getSlot(first + b);
+		springs.lengths[spring] = hypot(particles.xs[first + a] - particles.xs[first + b], particles.ys[first + a] - particles.ys[first + b]);
+		springs.strengths[spring] = layout.strength;
+		spring++;
+	});
+	if (results) {
+		for (int k = 0; k < count; k++) {
+			results[k] = Particle(&particles, first + k);
+		}
+	}
+	indexBuilt = false;
+	return count;
+}
+
+
+// Adds count particles with attributes drawn from the distribution, and returns how many were added. Each particle
+// draws from its own stream of the seed, so the particles are the same for any number of threads. When overlaps are
+// rejected, particles are placed one after another, and any that cannot be placed without overlapping another
+// particle within the distribution's number of attempts are left out.
+int Environment::addParticles(int count, ParticleDistribution const& distribution, uint64_t seed) {
+	if (count <= 0) {
+		return 0;
+	}
+	float right = distribution.right < 0 ? width : distribution.right;
+	float bottom = distribution.bottom < 0 ? height : distribution.bottom;
+	int first = particles.grow(count);
+	int tasks = (count + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK;
+	auto fillTask = [&](int task, int) {
+		for (int k = task * PARTICLE_CHUNK; k < std::min(count, (task + 1) * PARTICLE_CHUNK); k++) {
+			int i = first + k;
+			Random stream(seed, 2 * k);
+			Random placement(seed, 2 * k + 1);
+			float mass = stream.uniform(distribution.minMass, distribution.maxMass);
+			float size = distribution.size ? distribution.size(mass) : stream.uniform(distribution.minSize, distribution.maxSize);
+			float speed = stream.uniform(distribution.minSpeed, distribution.maxSpeed);
+			float angle = stream.uniform(distribution.minAngle, distribution.maxAngle);
+			particles.masses[i] = mass;
+			particles.sizes[i] = size;
+			particles.vxs[i] = sin(angle) * speed;
+			particles.vys[i] = -cos(angle) * speed;
+			particles.elasticities[i] = stream.uniform(distribution.minElasticity, distribution.maxElasticity);
+			particles.drags[i] = pow((mass / (mass + airMass)), size);
+			particles.xs[i] = placement.uniform(distribution.left + size, right - size);
+			particles.ys[i] = placement.uniform(distribution.top + size, bottom - size);
+		}
+	};
+	if (pool) {
+		pool->run(tasks, fillTask);
+	} else {
+		for (int task = 0; task < tasks; task++) {
+			fillTask(task, 0);
+		}
+	}
+	if (!distribution.rejectOverlaps) {
+		// Inserting so many particles one by one would leave the index with too few cells, so it is rebuilt instead.
+		indexBuilt = false;
+		return count;
+	}
+
+	// Size the index for every particle, then take the new particles back out and place them one after another,
+	// packing the placed ones together at the front of the new particles.
+	spatialIndex.build(particles, width, height);
+	for (int i = first; i < first + count; i++) {
+		spatialIndex.remove(particles.ids.getSlot(i));
+	}
+	indexBuilt = true;
+	indexMoved = false;
+	int placed = first;
+	for (int k = 0; k < count; k++) {
+		int i = first + k;
+		float size = particles.sizes[i];
+		// Each attempt draws the next position from the particle's placement stream, the first being the fill's.
+		Random placement(seed, 2 * k + 1);
+		for (int attempt = 0; attempt < distribution.maxAttempts; attempt++) {
+			float x = placement.uniform(distribution.left + size, right - size);
+			float y = placement.uniform(distribution.top + size, bottom - size);
+			float reach = size + spatialIndex.getMaxSize();
+			bool overlaps = false;
+			spatialIndex.forEachInBox(x - reach, y - reach, x + reach, y + reach, [&](int slot) {
+				int j = particles.ids.getIndex(slot);
+				float dx = particles.xs[j] - x;
+				float dy = particles.ys[j] - y;
+				float touch = particles.sizes[j] + size;
+				if (dx * dx + dy * dy < touch * touch) {
+					overlaps = true;
+				}
+			});
+			if (!overlaps) {
+				particles.masses[placed] = particles.masses[i];
+				particles.sizes[placed] = size;
+				particles.vxs[placed] = particles.vxs[i];
+				particles.vys[placed] = particles.vys[i];
+				particles.elasticities[placed] = particles.elasticities[i];
+				particles.drags[placed] = particles.drags[i];
+				particles.xs[placed] = x;
+				particles.ys[placed] = y;
+				spatialIndex.insert(particles.ids.getSlot(placed), x, y, size);
+				placed++;
+				break;
+			}
+		}
+	}
+	// Removed from the back of the new particles, so that any sleeping particles after them stay asleep.
+	for (int i = first + count - 1; i >= placed; i--) {
+		particles.remove(i);
+	}
+	return placed - first;
+}
+
+
+// Returns the particle from the environment at the coordinates (x, y), otherwise a null particle. Where particles
+// overlap, the one with the lowest index is returned, which is not necessarily the first added, as removing and
+// sleeping particles reorders them.
+Particle Environment::getParticle(float x, float y){
+	refreshIndex();
+	float r = spatialIndex.getMaxSize();
+	int found = -1;
+	spatialIndex.forEachInBox(x - r, y - r, x + r, y + r, [&](int slot) {
+		int i = particles.ids.getIndex(slot);
+		if (hypot(particles.xs[i] - x, particles.ys[i] - y) <= particles.sizes[i] && (found == -1 || i < found)) {
+			found = i;
+		}
+	});
+	return found != -1 ? Particle(&particles, found) : Particle();
 }
 
 
-// Returns a pointer to the particle from the environment at the coordinates (x, y), otherwise nullptr.
-Particle * Environment::getParticle(float x, float y){
-	for (int i = 0; i < particles.size(); i++) {
-		if (hypot(particles[i]->getX() - x, particles[i]->getY() - y) <= particles[i]->getSize()) {
-			return particles[i];
+// Fills results with the k particles whose centres are nearest to the coordinates (x, y), nearest first, and returns
+// how many were found, which is only less than k if there are fewer particles in the environment.
+int Environment::getNearestParticles(float x, float y, int k, Particle *results) {
+	refreshIndex();
+	int count = particles.getCount();
+	if (k <= 0) {
+		return 0;
+	}
+	if (nearestDistances.size() < k) {
+		nearestDistances.resize(k);
+	}
+	// Search ever larger circles until one holds k particles, which must then be the nearest. Once the box around the
+	// circle reaches every particle, the particles in its corners, outside the circle, are taken as well.
+	int found = 0;
+	int visited = 0;
+	bool whole = false;
+	float r = std::max(spatialIndex.getMaxSize(), 1.0f);
+	while (true) {
+		found = 0;
+		visited = 0;
+		spatialIndex.forEachInBox(x - r, y - r, x + r, y + r, [&](int slot) {
+			int i = particles.ids.getIndex(slot);
+			float d = hypot(particles.xs[i] - x, particles.ys[i] - y);
+			visited++;
+			if ((d > r && !whole) || (found == k && d >= nearestDistances[k - 1])) {
+				return;
+			}
+			// Insert the particle into the sorted results, dropping the furthest if they are full.
+			int j = found < k ? found++ : k - 1;
+			for (; j > 0 && nearestDistances[j - 1] > d; j--) {
+				nearestDistances[j] = nearestDistances[j - 1];
+				results[j] = results[j - 1];
+			}
+			nearestDistances[j] = d;
+			results[j] = Particle(&particles, particles.ids.getId(i));
+		});
+		if (found == k || whole) {
+			return found;
+		}
+		if (visited == count) {
+			whole = true;
+		} else {
+			r *= 2;
 		}
 	}
-	return nullptr;
 }
 
 
-// Adds a spring connecting two particles in the environment and returns a pointer to the spring.
-Spring * Environment::addSpring(Particle *p1, Particle *p2, float length, float strength) {
-	Spring *spring = new Spring(p1, p2, length, strength);
-	springs.push_back(spring);
-	return spring;
+// Fills results with up to capacity particles whose centres lie within the box from (left, top) to (right, bottom),
+// and returns how many there are in total.
+int Environment::getParticlesInBox(float left, float top, float right, float bottom, Particle *results, int capacity) {
+	refreshIndex();
+	int found = 0;
+	spatialIndex.forEachInBox(left, top, right, bottom, [&](int slot) {
+		int i = particles.ids.getIndex(slot);
+		float px = particles.xs[i];
+		float py = particles.ys[i];
+		if (px >= left && px <= right && py >= top && py <= bottom) {
+			if (found < capacity) {
+				results[found] = Particle(&particles, particles.ids.getId(i));
+			}
+			found++;
+		}
+	});
+	return found;
+}
+
+
+// Fills results with up to capacity particles whose centres lie within the radius of the coordinates (x, y), and
+// returns how many there are in total.
+int Environment::getParticlesInRadius(float x, float y, float radius, Particle *results, int capacity) {
+	refreshIndex();
+	int found = 0;
+	spatialIndex.forEachInBox(x - radius, y - radius, x + radius, y + radius, [&](int slot) {
+		int i = particles.ids.getIndex(slot);
+		if (hypot(particles.xs[i] - x, particles.ys[i] - y) <= radius) {
+			if (found < capacity) {
+				results[found] = Particle(&particles, particles.ids.getId(i));
+			}
+			found++;
+		}
+	});
+	return found;
+}
+
+
+// Copies the position and size of up to capacity particles into buffer as consecutive (x, y, size) triples, in the
+// order the particles are iterated, and returns the number of particles in the environment.
+int Environment::exportParticles(float *buffer, int capacity) {
+	int count = std::min(particles.getCount(), capacity);
+	for (int i = 0; i < count; i++) {
+		buffer[3 * i] = particles.xs[i];
+		buffer[3 * i + 1] = particles.ys[i];
+		buffer[3 * i + 2] = particles.sizes[i];
+	}
+	return particles.getCount();
+}
+
+
+// Fills the batch with the particles and springs visible in the view, from the latest snapshot. Like stepAsync, this
+// turns on publishing snapshots, so it can be called while the next update runs.
+void Environment::extractRender(RenderView view, RenderBatch &batch) {
+	if (!publishSnapshots) {
+		setPublishSnapshots(true);
+	}
+	if (view.width < 0) {
+		view.width = width;
+	}
+	if (view.height < 0) {
+		view.height = height;
+	}
+	::extractRender(getSnapshot(), view, batch);
+}
+
+
+// Adds a spring connecting two particles in the environment and returns the spring.
+Spring Environment::addSpring(Particle p1, Particle p2, float length, float strength) {
+	return Spring(&springs, springs.add(p1.getId().slot, p2.getId().slot, length, strength));
 }
 
 
 // Bounces a particle if in contact with boundary of the environment.
-void Environment::bounce(Particle *particle) {
+void Environment::bounce(Particle particle) {
+	float size = particle.getSize();
+	float e = particle.getElasticity();
 	// Particle hits the right boundary:
-	if (particle->getX() > (width - particle->getSize())) {
-		particle->setX(2 * (width - particle->getSize()) - particle->getX());
-		particle->setAngle(-particle->getAngle());
-		particle->setSpeed(particle->getSpeed() * particle->getElasticity());
+	if (particle.getX() > (width - size)) {
+		particle.setX(2 * (width - size) - particle.getX());
+		particle.setVelocity(-particle.getVelocityX() * e, particle.getVelocityY() * e);
 	// Particle hits the left boundary:
-	} else if (particle->getX() < particle->getSize()) {
-		particle->setX(2 * particle->getSize() - particle->getX());
-		particle->setAngle(-particle->getAngle());
-		particle->setSpeed(particle->getSpeed() * particle->getElasticity());
+	} else if (particle.getX() < size) {
+		particle.setX(2 * size - particle.getX());
+		particle.setVelocity(-particle.getVelocityX() * e, particle.getVelocityY() * e);
 	}
 	// Particle hits the bottom boundary:
-	if (particle->getY() > (height - particle->getSize())) {
-		particle->setY(2 * (height - particle->getSize()) - particle->getY());
-		particle->setAngle(M_PI - particle->getAngle());
-		particle->setSpeed(particle->getSpeed() * particle->getElasticity());
+	if (particle.getY() > (height - size)) {
+		particle.setY(2 * (height - size) - particle.getY());
+		particle.setVelocity(particle.getVelocityX() * e, -particle.getVelocityY() * e);
 	// Particle hits the top boundary:
-	} else if (particle->getY() < particle->getSize()) {
-		particle->setY(2 * particle->getSize() - particle->getY());
-		particle->setAngle(M_PI - particle->getAngle());
-		particle->setSpeed(particle->getSpeed() * particle->getElasticity());
+	} else if (particle.getY() < size) {
+		particle.setY(2 * size - particle.getY());
+		particle.setVelocity(particle.getVelocityX() * e, -particle.getVelocityY() * e);
+	}
+}
+
+
+// Removes a particle, and any springs attached to it, from the environment. The last particle is moved into its
+// place, so the order of the particles changes. Particles that have already been removed are ignored.
+void Environment::removeParticle(Particle particle) {
+	if (particle) {
+		springs.removeAttached(particle.getId().slot);
+		if (indexBuilt) {
+			spatialIndex.remove(particle.getId().slot);
+		}
+		particles.remove(particle.getIndex());
+	}
+}
+
+
+// Removes a spring from the environment. Springs that have already been removed are ignored.
+void Environment::removeSpring(Spring spring) {
+	if (spring) {
+		springs.remove(spring.getIndex());
+	}
+}
+
+
+// Loads an environment saved by saveCheckpoint, and returns it, or nullptr if the file cannot be read or is not a
+// checkpoint of this version. The file is memory mapped and each array is copied straight into the environment, so
+// loading takes little more than reading the file. Particles keep their order, but are given new slots, so handles to
+// the saved environment's particles and springs do not refer to the loaded ones.
+std::unique_ptr<Environment> Environment::loadCheckpoint(const char *path) {
+	MappedFile file;
+	if (!file.open(path) || file.getSize() < sizeof(CheckpointHeader)) {
+		return nullptr;
+	}
+	const unsigned char *data = file.getData();
+	CheckpointHeader header;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, "CPPCKPT", 8) != 0 || header.version != CHECKPOINT_VERSION
+		|| header.byteOrder != 0x01020304 || header.headerSize != sizeof(header) || header.width <= 0
+		|| header.height <= 0 || header.particleCount < 0 || header.particleCount > INT_MAX || header.springCount < 0
+		|| header.springCount > INT_MAX || header.attraction < ALL_PAIRS || header.attraction > BARNES_HUT
+		|| header.broadphase < BRUTE_FORCE || header.broadphase > SWEEP_AND_PRUNE || header.integrator < EXPLICIT_EULER
+		|| header.integrator > VELOCITY_VERLET) {
+		return nullptr;
+	}
+	// Every array must lie within the file, on its alignment.
+	uint64_t offsets[14];
+	memcpy(offsets, header.particleOffsets, sizeof(header.particleOffsets));
+	memcpy(offsets + 10, header.springOffsets, sizeof(header.springOffsets));
+	for (int k = 0; k < 14; k++) {
+		uint64_t offset = offsets[k];
+		uint64_t bytes = 4 * (k < 10 ? header.particleCount : header.springCount);
+		if (offset % CHECKPOINT_ALIGNMENT != 0 || offset > file.getSize() || bytes > file.getSize() - offset) {
+			return nullptr;
+		}
+	}
+	int count = header.particleCount;
+	int springCount = header.springCount;
+	const int32_t *p1s = reinterpret_cast<const int32_t *>(data + header.springOffsets[0]);
+	const int32_t *p2s = reinterpret_cast<const int32_t *>(data + header.springOffsets[1]);
+	for (int i = 0; i < springCount; i++) {
+		if (p1s[i] < 0 || p1s[i] >= count || p2s[i] < 0 || p2s[i] >= count) {
+			return nullptr;
+		}
+	}
+
+	std::unique_ptr<Environment> env(new Environment(header.width, header.height));
+	env->allowAccelerate = header.flags & CHECKPOINT_ACCELERATE;
+	env->allowAttract = header.flags & CHECKPOINT_ATTRACT;
+	env->allowBounce = header.flags & CHECKPOINT_BOUNCE;
+	env->allowCollide = header.flags & CHECKPOINT_COLLIDE;
+	env->allowCombine = header.flags & CHECKPOINT_COMBINE;
+	env->allowDrag = header.flags & CHECKPOINT_DRAG;
+	env->allowMove = header.flags & CHECKPOINT_MOVE;
+	env->attraction = static_cast<Attraction>(header.attraction);
+	env->broadphase = static_cast<Broadphase>(header.broadphase);
+	env->integrator = static_cast<Integrator>(header.integrator);
+	env->airMass = header.airMass;
+	env->elasticity = header.elasticity;
+	env->acceleration = Vector{header.accelerationAngle, header.accelerationSpeed};
+	env->openingAngle = header.openingAngle;
+	env->softening = header.softening;
+	env->steps = header.steps;
+
+	ParticleStore &store = env->particles;
+	AlignedVector<float> *arrays[10] = {&store.xs, &store.ys, &store.vxs, &store.vys, &store.sizes, &store.masses,
+		&store.elasticities, &store.drags, &store.deferredVxs, &store.deferredVys};
+	store.reserve(count);
+	store.grow(count);
+	for (int k = 0; k < 10; k++) {
+		memcpy(arrays[k]->data(), data + header.particleOffsets[k], 4 * (size_t)count);
+	}
+	const float *lengths = reinterpret_cast<const float *>(data + header.springOffsets[2]);
+	const float *strengths = reinterpret_cast<const float *>(data + header.springOffsets[3]);
+	env->springs.reserve(springCount);
+	for (int i = 0; i < springCount; i++) {
+		env->springs.add(store.ids.getSlot(p1s[i]), store.ids.getSlot(p2s[i]), lengths[i], strengths[i]);
+	}
+	return env;
+}
+
+
+// Saves the environment's settings, particles and springs to a checkpoint file, returning whether it was written.
+// The integrator and the velocity it holds back for the next step are saved, so a loaded environment carries on as
+// the saved one would have. The merge size rule and stats callback are functions, so they are not saved. Nor are
+// sleeping and the spring solver, so every particle of a loaded environment starts awake, and its springs are updated
+// by forces.
+bool Environment::saveCheckpoint(const char *path) {
+	int count = particles.getCount();
+	int springCount = springs.getCount();
+	CheckpointHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "CPPCKPT", 8);
+	header.version = CHECKPOINT_VERSION;
+	header.byteOrder = 0x01020304;
+	header.headerSize = sizeof(header);
+	header.flags = (allowAccelerate ? CHECKPOINT_ACCELERATE : 0) | (allowAttract ? CHECKPOINT_ATTRACT : 0)
+		| (allowBounce ? CHECKPOINT_BOUNCE : 0) | (allowCollide ? CHECKPOINT_COLLIDE : 0)
+		| (allowCombine ? CHECKPOINT_COMBINE : 0) | (allowDrag ? CHECKPOINT_DRAG : 0) | (allowMove ? CHECKPOINT_MOVE : 0);
+	header.width = width;
+	header.height = height;
+	header.attraction = attraction;
+	header.broadphase = broadphase;
+	header.integrator = integrator;
+	header.airMass = airMass;
+	header.elasticity = elasticity;
+	header.accelerationAngle = acceleration.angle;
+	header.accelerationSpeed = acceleration.speed;
+	header.openingAngle = openingAngle;
+	header.softening = softening;
+	header.steps = steps;
+	header.particleCount = count;
+	header.springCount = springCount;
+
+	// The ends of the springs are saved as particle indices, since the slots are not saved.
+	AlignedVector<int32_t> p1s(springCount);
+	AlignedVector<int32_t> p2s(springCount);
+	for (int i = 0; i < springCount; i++) {
+		p1s[i] = particles.ids.getIndex(springs.p1s[i]);
+		p2s[i] = particles.ids.getIndex(springs.p2s[i]);
+	}
+	const void *arrays[14] = {particles.xs.data(), particles.ys.data(), particles.vxs.data(), particles.vys.data(),
+		particles.sizes.data(), particles.masses.data(), particles.elasticities.data(), particles.drags.data(),
+		particles.deferredVxs.data(), particles.deferredVys.data(), p1s.data(), p2s.data(), springs.lengths.data(),
+		springs.strengths.data()};
+	uint64_t offsets[14];
+	uint64_t offset = sizeof(header);
+	for (int k = 0; k < 14; k++) {
+		offset = (offset + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+		offsets[k] = offset;
+		offset += 4 * (uint64_t)(k < 10 ? count : springCount);
+	}
+	memcpy(header.particleOffsets, offsets, sizeof(header.particleOffsets));
+	memcpy(header.springOffsets, offsets + 10, sizeof(header.springOffsets));
+
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		return false;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+	uint64_t position = sizeof(header);
+	const char padding[CHECKPOINT_ALIGNMENT] = {};
+	for (int k = 0; k < 14 && written; k++) {
+		uint64_t start = offsets[k];
+		size_t bytes = 4 * (size_t)(k < 10 ? count : springCount);
+		written = fwrite(padding, 1, start - position, file) == start - position
+			&& fwrite(arrays[k], 1, bytes, file) == bytes;
+		position = start + bytes;
+	}
+	return fclose(file) == 0 && written;
+}
+
+
+// Attracts every pair of particles to each other.
+void Environment::attractParticles() {
+	CPPARTICLES_TRACE_SCOPE("attract");
+	int count = particles.getCount();
+	int tasks = (count + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK;
+	if (attraction == ALL_PAIRS && pool) {
+		// Each task sums the whole attraction on its own particles, so no two tasks write to the same particle.
+		pool->run(tasks, [&](int task, int) {
+			for (int i = task * PARTICLE_CHUNK; i < std::min(count, (task + 1) * PARTICLE_CHUNK); i++) {
+				float ax = 0;
+				float ay = 0;
+				for (int j = 0; j < count; j++) {
+					float dx = particles.xs[j] - particles.xs[i];
+					float dy = particles.ys[j] - particles.ys[i];
+					float distance2 = dx * dx + dy * dy;
+					if (j != i) {
+						float a = GRAVITATIONAL_CONSTANT * particles.masses[j] / (distance2 * sqrt(distance2));
+						ax += a * dx;
+						ay += a * dy;
+					}
+				}
+				Particle(&particles, i).accelerate(ax, ay);
+			}
+		});
+		return;
+	}
+	if (attraction == ALL_PAIRS) {
+		for (int i = 0; i < particles.getCount(); i++) {
+			for (int x = i + 1; x < particles.getCount(); x++) {
+				Particle(&particles, i).attract(Particle(&particles, x));
+			}
+		}
+		return;
+	}
+
+	// The tree keeps its own copy of the positions and masses, so accelerating particles does not invalidate it.
+	quadTree.build(particles, 0, 0, width, height);
+	if (pool) {
+		pool->run(tasks, [&](int task, int) {
+			for (int i = task * PARTICLE_CHUNK; i < std::min(count, (task + 1) * PARTICLE_CHUNK); i++) {
+				float ax, ay;
+				quadTree.getAcceleration(i, openingAngle, softening, ax, ay);
+				Particle(&particles, i).accelerate(ax, ay);
+			}
+		});
+		return;
+	}
+	for (int i = 0; i < count; i++) {
+		float ax, ay;
+		quadTree.getAcceleration(i, openingAngle, softening, ax, ay);
+		Particle(&particles, i).accelerate(ax, ay);
+	}
+}
+
+
+// Keeps the velocity of every particle before a phase that applies forces, for endForces.
+void Environment::beginForces() {
+	forceVxs.assign(particles.vxs.begin(), particles.vxs.end());
+	forceVys.assign(particles.vys.begin(), particles.vys.end());
+}
+
+
+// Collides particle i with particle j, which may be asleep, and returns whether they were in contact. The contact is
+// counted, and recorded for the sleeping islands and as an event if they are turned on.
+bool Environment::collidePair(int i, int j, int awake) {
+	float vx = 0;
+	float vy = 0;
+	float x = 0;
+	float y = 0;
+	if (recordEvents) {
+		float share = particles.sizes[i] / (particles.sizes[i] + particles.sizes[j]);
+		vx = particles.vxs[i];
+		vy = particles.vys[i];
+		x = particles.xs[i] + (particles.xs[j] - particles.xs[i]) * share;
+		y = particles.ys[i] + (particles.ys[j] - particles.ys[i]) * share;
+	}
+	if (!(j < awake ? Particle(&particles, i).collide(Particle(&particles, j)) : collideSleeping(i, j))) {
+		return false;
+	}
+	collisions++;
+	if (allowSleep) {
+		contacts.push_back(std::make_pair(particles.ids.getId(i), particles.ids.getId(j)));
+	}
+	if (recordEvents) {
+		float mass = particles.masses[i];
+		contactEvents.push_back(ContactEvent{Particle(&particles, i), Particle(&particles, j),
+			(particles.vxs[i] - vx) * mass, (particles.vys[i] - vy) * mass, x, y});
+	}
+	return true;
+}
+
+
+// Collides all particles in contact on the worker threads. Every contact is calculated from the positions and
+// velocities at the start of the pass and recorded in its task's impulse buffer. The buffers are then applied in task
+// order, so the result does not depend on which worker ran which task, or on how many workers there are. Only pairs
+// with an awake particle are tested, as sleeping particles have not moved since they last touched.
+void Environment::collideParallel() {
+	CPPARTICLES_TRACE_SCOPE("collide");
+	int count = particles.getCount();
+	int awake = particles.getAwakeCount();
+	int tasks = (awake + CONTACT_CHUNK - 1) / CONTACT_CHUNK;
+	if (broadphase == UNIFORM_GRID) {
+		grid.build(particles);
+	} else if (broadphase == SWEEP_AND_PRUNE) {
+		sweepAndPrune.update(particles, awake);
+	}
+	if (taskImpulses.size() < tasks) {
+		taskImpulses.resize(tasks);
+		taskContactEvents.resize(tasks);
+	}
+	taskPairTests.assign(tasks, 0);
+	if (broadphase == UNIFORM_GRID) {
+		pool->run(tasks, [&](int task, int worker) { collideTask<UNIFORM_GRID>(task, worker, count, awake); });
+	} else if (broadphase == SWEEP_AND_PRUNE) {
+		pool->run(tasks, [&](int task, int worker) { collideTask<SWEEP_AND_PRUNE>(task, worker, count, awake); });
+	} else {
+		pool->run(tasks, [&](int task, int worker) { collideTask<BRUTE_FORCE>(task, worker, count, awake); });
+	}
+	// A particle in several contacts receives the average of their impulses. Summing them instead would add the
+	// other particles' momentum several times over, and crowded regions would gain energy every update.
+	impulseCounts.assign(count, 0);
+	impulseTotals.assign(count, Impulse{0, 0, 0, 0, 0});
+	for (int task = 0; task < tasks; task++) {
+		pairTests += taskPairTests[task];
+		collisions += taskImpulses[task].size() / 2;
+		AlignedVector<Impulse> &impulses = taskImpulses[task];
+		if (allowSleep) {
+			for (int k = 0; k < impulses.size(); k += 2) {
+				contacts.push_back(std::make_pair(particles.ids.getId(impulses[k].index), particles.ids.getId(impulses[k + 1].index)));
+			}
+		}
+		if (recordEvents) {
+			contactEvents.insert(contactEvents.end(), taskContactEvents[task].begin(), taskContactEvents[task].end());
+		}
+		for (int k = 0; k < impulses.size(); k++) {
+			Impulse &impulse = impulses[k];
+			Impulse &total = impulseTotals[impulse.index];
+			impulseCounts[impulse.index]++;
+			total.dvx += impulse.dvx;
+			total.dvy += impulse.dvy;
+			total.dx += impulse.dx;
+			total.dy += impulse.dy;
+		}
+	}
+	for (int i = 0; i < count; i++) {
+		if (impulseCounts[i] > 0) {
+			Impulse &total = impulseTotals[i];
+			particles.vxs[i] += total.dvx / impulseCounts[i];
+			particles.vys[i] += total.dvy / impulseCounts[i];
+			particles.xs[i] += total.dx / impulseCounts[i];
+			particles.ys[i] += total.dy / impulseCounts[i];
+		}
+	}
+}
+
+
+// Collides an awake particle with a sleeping one and returns whether they were in contact. The sleeping particle is not
+// moved, so the awake particle is pushed the whole way out of it. Its velocity still changes, so that a hard enough hit
+// wakes it.
+bool Environment::collideSleeping(int i, int j) {
+	Collision collision;
+	if (!Particle(&particles, i).getCollision(Particle(&particles, j), collision)) {
+		return false;
+	}
+	particles.vxs[i] = collision.vx1;
+	particles.vys[i] = collision.vy1;
+	particles.vxs[j] = collision.vx2;
+	particles.vys[j] = collision.vy2;
+	particles.xs[i] += collision.dx + collision.dx;
+	particles.ys[i] += collision.dy + collision.dy;
+	return true;
+}
+
+
+// Records the impulses of the contacts of the particles in one task of the threaded collision pass, along with their
+// events if they are turned on. Each task writes only to its own buffers, so the workers need no locks. The broadphase
+// is a template parameter, so the choice of partners is compiled into the loop rather than tested for every pair.
+template <Broadphase B>
+void Environment::collideTask(int task, int worker, int count, int awake) {
+	AlignedVector<Impulse> &impulses = taskImpulses[task];
+	AlignedVector<ContactEvent> &events = taskContactEvents[task];
+	AlignedVector<int> &neighbours = workerCandidates[worker];
+	impulses.clear();
+	events.clear();
+	for (int i = task * CONTACT_CHUNK; i < std::min(awake, (task + 1) * CONTACT_CHUNK); i++) {
+		int total = count - i - 1;
+		const int *partners = nullptr;
+		if constexpr (B == UNIFORM_GRID) {
+			grid.neighbours(i, i, neighbours);
+			total = neighbours.size();
+			partners = neighbours.data();
+		} else if constexpr (B == SWEEP_AND_PRUNE) {
+			total = sweepAndPrune.getNeighbourCount(i);
+			partners = sweepAndPrune.getNeighbours(i);
+		}
+		taskPairTests[task] += total;
+		for (int k = 0; k < total; k++) {
+			int j = B == BRUTE_FORCE ? i + 1 + k : partners[k];
+			Collision collision;
+			if (!Particle(&particles, i).getCollision(Particle(&particles, j), collision)) {
+				continue;
+			}
+			if (j < awake) {
+				impulses.push_back(Impulse{i, collision.vx1 - particles.vxs[i], collision.vy1 - particles.vys[i], collision.dx, collision.dy});
+				impulses.push_back(Impulse{j, collision.vx2 - particles.vxs[j], collision.vy2 - particles.vys[j], -collision.dx, -collision.dy});
+			} else {
+				// A sleeping particle is not moved, so the awake particle is pushed the whole way out of it.
+				impulses.push_back(Impulse{i, collision.vx1 - particles.vxs[i], collision.vy1 - particles.vys[i], collision.dx + collision.dx, collision.dy + collision.dy});
+				impulses.push_back(Impulse{j, collision.vx2 - particles.vxs[j], collision.vy2 - particles.vys[j], 0, 0});
+			}
+			if (recordEvents) {
+				float mass = particles.masses[i];
+				float share = particles.sizes[i] / (particles.sizes[i] + particles.sizes[j]);
+				events.push_back(ContactEvent{Particle(&particles, i), Particle(&particles, j),
+					(collision.vx1 - particles.vxs[i]) * mass, (collision.vy1 - particles.vys[i]) * mass,
+					particles.xs[i] + (particles.xs[j] - particles.xs[i]) * share,
+					particles.ys[i] + (particles.ys[j] - particles.ys[i]) * share});
+			}
+		}
+	}
+}
+
+
+// Returns how many steps to divide an update of dt frames into, so that no awake particle moves further than the
+// Courant number times its size in one step, up to the largest number of substeps allowed. The count is taken from the
+// velocities at the start of the update.
+int Environment::countSubsteps(float dt) {
+	if (maxSubsteps <= 1 || !(dt > 0)) {
+		return 1;
+	}
+	// Largest speed of a particle relative to its size, squared.
+	float fastest = 0;
+	int awake = particles.getAwakeCount();
+	for (int i = 0; i < awake; i++) {
+		float speed2 = particles.vxs[i] * particles.vxs[i] + particles.vys[i] * particles.vys[i];
+		fastest = std::max(fastest, speed2 / (particles.sizes[i] * particles.sizes[i]));
+	}
+	float substeps = ceil(sqrt(fastest) * fabs(dt) / courantNumber);
+	return substeps < maxSubsteps ? std::max(1, static_cast<int>(substeps)) : maxSubsteps;
+}
+
+
+// Scales the change in velocity since beginForces by the length of the step, and holds back the part that the
+// integrator applies in the next step: all of it for explicit Euler, which moves by the velocity from before the
+// forces, and half of it for velocity Verlet, which applies half before the next move.
+void Environment::endForces(float dt) {
+	float held = integrator == EXPLICIT_EULER ? 1 : integrator == VELOCITY_VERLET ? 0.5 : 0;
+	for (int i = 0; i < particles.getCount(); i++) {
+		float dvx = (particles.vxs[i] - forceVxs[i]) * dt;
+		float dvy = (particles.vys[i] - forceVys[i]) * dt;
+		particles.vxs[i] = forceVxs[i] + dvx * (1 - held);
+		particles.vys[i] = forceVys[i] + dvy * (1 - held);
+		particles.deferredVxs[i] += dvx * held;
+		particles.deferredVys[i] += dvy * held;
 	}
 }
 
 
-// Removes a particle from the environment.
-void Environment::removeParticle(Particle *particle) {
-	for (int i = 0; i < particles.size(); i++) {
-		if (particle == particles[i]) {
-			delete particles[i];
-			particles.erase(particles.begin() + i);
+// Finds every pair of overlapping particles with an awake particle, using the broadphase to skip pairs that are too far
+// apart.
+void Environment::findOverlaps() {
+	CPPARTICLES_TRACE_SCOPE("find overlaps");
+	int count = particles.getCount();
+	int awake = particles.getAwakeCount();
+	int tasks = (awake + CONTACT_CHUNK - 1) / CONTACT_CHUNK;
+	if (broadphase == UNIFORM_GRID) {
+		grid.build(particles);
+	} else if (broadphase == SWEEP_AND_PRUNE) {
+		sweepAndPrune.update(particles, awake);
+	}
+	if (taskOverlaps.size() < tasks) {
+		taskOverlaps.resize(tasks);
+	}
+	taskPairTests.assign(tasks, 0);
+	auto findTask = [&](int task, int worker) {
+		if (broadphase == UNIFORM_GRID) {
+			findOverlapsTask<UNIFORM_GRID>(task, worker, count, awake);
+		} else if (broadphase == SWEEP_AND_PRUNE) {
+			findOverlapsTask<SWEEP_AND_PRUNE>(task, worker, count, awake);
+		} else {
+			findOverlapsTask<BRUTE_FORCE>(task, worker, count, awake);
+		}
+	};
+	if (pool) {
+		pool->run(tasks, findTask);
+	} else {
+		for (int task = 0; task < tasks; task++) {
+			findTask(task, 0);
+		}
+	}
+	overlaps.clear();
+	for (int task = 0; task < tasks; task++) {
+		pairTests += taskPairTests[task];
+		overlaps.insert(overlaps.end(), taskOverlaps[task].begin(), taskOverlaps[task].end());
+	}
+	// Particles merged into a sleeping particle wake it, like any other contact.
+	if (allowSleep) {
+		for (int k = 0; k < overlaps.size(); k++) {
+			contacts.push_back(std::make_pair(particles.ids.getId(overlaps[k].first), particles.ids.getId(overlaps[k].second)));
 		}
 	}
 }
 
 
-// Removes a spring from the environment.
-void Environment::removeSpring(Spring *spring) {
-	for (int i = 0; i < springs.size(); i++) {
-		if (spring == springs[i]) {
-			delete springs[i];
-			springs.erase(springs.begin() + i);
+// Finds the overlapping pairs of the particles in one task of findOverlaps, with the broadphase compiled into the loop.
+template <Broadphase B>
+void Environment::findOverlapsTask(int task, int worker, int count, int awake) {
+	AlignedVector<std::pair<int, int> > &pairs = taskOverlaps[task];
+	AlignedVector<int> &neighbours = workerCandidates[worker];
+	pairs.clear();
+	for (int i = task * CONTACT_CHUNK; i < std::min(awake, (task + 1) * CONTACT_CHUNK); i++) {
+		int total = count - i - 1;
+		const int *partners = nullptr;
+		if constexpr (B == UNIFORM_GRID) {
+			grid.neighbours(i, i, neighbours);
+			total = neighbours.size();
+			partners = neighbours.data();
+		} else if constexpr (B == SWEEP_AND_PRUNE) {
+			total = sweepAndPrune.getNeighbourCount(i);
+			partners = sweepAndPrune.getNeighbours(i);
+		}
+		taskPairTests[task] += total;
+		for (int k = 0; k < total; k++) {
+			int j = B == BRUTE_FORCE ? i + 1 + k : partners[k];
+			float dx = particles.xs[i] - particles.xs[j];
+			float dy = particles.ys[i] - particles.ys[j];
+			float reach = particles.sizes[i] + particles.sizes[j];
+			if (dx * dx + dy * dy < reach * reach) {
+				pairs.push_back(std::make_pair(i, j));
+			}
 		}
 	}
 }
 
 
-// Updates all particles and springs in the environment.
-void Environment::update() {
-	for (int i = 0; i < particles.size(); i++) {
-		Particle *particle = particles[i];
-		if (allowAccelerate) {
-			particle->accelerate(acceleration);
+// Calls the function with the index of each spring of a color, splitting the color between the workers. Springs of one
+// color share no particles, so they can be updated at the same time.
+template <typename Function>
+void Environment::forEachInColor(int color, Function const& function) {
+	int start = springs.colorOffsets[color];
+	int end = springs.colorOffsets[color + 1];
+	pool->run((end - start + SPRING_CHUNK - 1) / SPRING_CHUNK, [&](int task, int) {
+		for (int n = start + task * SPRING_CHUNK; n < std::min(end, start + (task + 1) * SPRING_CHUNK); n++) {
+			function(springs.colored[n]);
 		}
-		if (allowMove) {
-			particle->move();
+	});
+}
+
+
+// Adds the time since start to a phase of the stats, and restarts the clock for the next phase.
+void Environment::lap(Phase phase, std::chrono::steady_clock::time_point &start) {
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	stats.phaseSeconds[phase] += std::chrono::duration<double>(now - start).count();
+	start = now;
+}
+
+
+// Combines every group of overlapping particles, including chains of particles that each overlap the next, into the
+// heaviest particle of the group. The group's mass and momentum are conserved, and the survivor is moved to its
+// centre of mass. The other particles are then removed together.
+void Environment::mergeParticles() {
+	CPPARTICLES_TRACE_SCOPE("combine");
+	findOverlaps();
+	if (overlaps.empty()) {
+		return;
+	}
+	int count = particles.getCount();
+	groups.reset(count);
+	merging.assign(count, false);
+	for (int k = 0; k < overlaps.size(); k++) {
+		groups.unite(overlaps[k].first, overlaps[k].second);
+		merging[overlaps[k].first] = true;
+		merging[overlaps[k].second] = true;
+	}
+
+	// Sum each group in index order, so the result does not depend on the order the overlaps were found in.
+	mergeTotals.assign(count, MergeTotal{0, 0, 0, 0, 0, -1});
+	for (int i = 0; i < count; i++) {
+		if (merging[i]) {
+			MergeTotal &total = mergeTotals[groups.find(i)];
+			float mass = particles.masses[i];
+			total.mass += mass;
+			total.x += mass * particles.xs[i];
+			total.y += mass * particles.ys[i];
+			total.vx += mass * particles.vxs[i];
+			total.vy += mass * particles.vys[i];
+			if (total.survivor == -1 || mass > particles.masses[total.survivor]) {
+				total.survivor = i;
+			}
+		}
+	}
+
+	absorbed.clear();
+	for (int i = 0; i < count; i++) {
+		if (!merging[i]) {
+			continue;
+		}
+		MergeTotal &total = mergeTotals[groups.find(i)];
+		int survivor = total.survivor;
+		if (i != survivor) {
+			absorbed.push_back(particles.ids.getId(i));
+			particles.collideWith[survivor] = particles.ids.getId(i);
+			if (recordEvents) {
+				mergeEvents.push_back(MergeEvent{Particle(&particles, survivor), Particle(&particles, i)});
+			}
+		}
+		if (groups.find(i) != i || total.mass <= 0) {
+			continue;
+		}
+		float mass = total.mass;
+		float size = particles.sizes[survivor];
+		// Without a rule, the survivor keeps its density as it grows.
+		float newSize = mergeSize ? mergeSize(mass) : size * sqrt(mass / particles.masses[survivor]);
+		particles.masses[survivor] = mass;
+		particles.xs[survivor] = total.x / mass;
+		particles.ys[survivor] = total.y / mass;
+		particles.vxs[survivor] = total.vx / mass;
+		particles.vys[survivor] = total.vy / mass;
+		particles.sizes[survivor] = newSize;
+		particles.drags[survivor] = pow((mass / (mass + airMass)), newSize);
+	}
+	for (int k = 0; k < absorbed.size(); k++) {
+		removeParticle(Particle(&particles, absorbed[k]));
+	}
+}
+
+
+// Moves the ends of each spring towards its length, treating the spring as a constraint in extended position based
+// dynamics. A spring's compliance, the inverse of its stiffness, is the spring compliance divided by its strength, so
+// that it is as stiff as with forces, but a stiff spring no longer overshoots. The springs are projected in turn, over
+// a number of iterations, and each particle's velocity gains the distance it is moved over the step. The threaded
+// update projects the springs a color at a time.
+void Environment::projectSprings(float dt) {
+	// A step of no time cannot move the particles towards the springs' lengths.
+	if (!(dt > 0)) {
+		return;
+	}
+	int count = springs.getCount();
+	int awake = particles.getAwakeCount();
+	springLambdas.assign(count, 0);
+	auto project = [&](int k) {
+		int i = particles.ids.getIndex(springs.p1s[k]);
+		int j = particles.ids.getIndex(springs.p2s[k]);
+		// Sleeping particles are left where they are, as if their mass were infinite.
+		float w1 = i < awake ? 1 / particles.masses[i] : 0;
+		float w2 = j < awake ? 1 / particles.masses[j] : 0;
+		if (w1 + w2 <= 0 || springs.strengths[k] <= 0) {
+			return;
 		}
-		if (allowDrag) {
-			particle->experienceDrag();
+		float compliance = springCompliance / springs.strengths[k] / (dt * dt);
+		float dx = particles.xs[i] - particles.xs[j];
+		float dy = particles.ys[i] - particles.ys[j];
+		float distance = hypot(dx, dy);
+		// Unit vector from p2 to p1. Particles at the same position are pushed apart along x.
+		float nx = distance > 0 ? dx / distance : 1;
+		float ny = distance > 0 ? dy / distance : 0;
+		float lambda = (springs.lengths[k] - distance - compliance * springLambdas[k]) / (w1 + w2 + compliance);
+		springLambdas[k] += lambda;
+		particles.xs[i] += w1 * lambda * nx;
+		particles.ys[i] += w1 * lambda * ny;
+		particles.vxs[i] += w1 * lambda * nx / dt;
+		particles.vys[i] += w1 * lambda * ny / dt;
+		particles.xs[j] -= w2 * lambda * nx;
+		particles.ys[j] -= w2 * lambda * ny;
+		particles.vxs[j] -= w2 * lambda * nx / dt;
+		particles.vys[j] -= w2 * lambda * ny / dt;
+	};
+	if (pool) {
+		springs.color();
+	}
+	int colors = pool ? springs.getColorCount() : 0;
+	// Each iteration projects the springs forwards then backwards, since always projecting them in the same order can
+	// feed energy into a braced lattice.
+	for (int pass = 0; pass < 2 * springIterations; pass++) {
+		if (pool) {
+			for (int n = 0; n < colors; n++) {
+				forEachInColor(pass % 2 == 0 ? n : colors - 1 - n, project);
+			}
+		} else {
+			for (int n = 0; n < count; n++) {
+				project(pass % 2 == 0 ? n : count - 1 - n);
+			}
 		}
-		if (allowBounce) {
-			bounce(particle);
+	}
+}
+
+
+// Copies the particles and springs into the back snapshot buffer and publishes it to readers.
+void Environment::publishSnapshot() {
+	CPPARTICLES_TRACE_SCOPE("publish snapshot");
+	Snapshot &snapshot = snapshots.getBack();
+	int count = particles.getCount();
+	snapshot.step = steps;
+	snapshot.ids.resize(count);
+	for (int i = 0; i < count; i++) {
+		snapshot.ids[i] = particles.ids.getId(i);
+	}
+	snapshot.xs.assign(particles.xs.begin(), particles.xs.end());
+	snapshot.ys.assign(particles.ys.begin(), particles.ys.end());
+	snapshot.vxs.assign(particles.vxs.begin(), particles.vxs.end());
+	snapshot.vys.assign(particles.vys.begin(), particles.vys.end());
+	snapshot.sizes.assign(particles.sizes.begin(), particles.sizes.end());
+	snapshot.masses.assign(particles.masses.begin(), particles.masses.end());
+	int springCount = springs.getCount();
+	snapshot.p1s.resize(springCount);
+	snapshot.p2s.resize(springCount);
+	for (int i = 0; i < springCount; i++) {
+		snapshot.p1s[i] = particles.ids.getIndex(springs.p1s[i]);
+		snapshot.p2s[i] = particles.ids.getIndex(springs.p2s[i]);
+	}
+	snapshot.lengths.assign(springs.lengths.begin(), springs.lengths.end());
+	snapshot.strengths.assign(springs.strengths.begin(), springs.strengths.end());
+	snapshots.publish();
+}
+
+
+// Brings the spatial index up to date with the particles before a query. The index is built by the first query, then
+// refreshed by the first query after each update, so particles moved by hand between updates are found by their
+// positions at the end of the last update.
+void Environment::refreshIndex() {
+	if (!indexBuilt) {
+		spatialIndex.build(particles, width, height);
+		indexBuilt = true;
+	} else if (indexMoved) {
+		spatialIndex.refresh(particles, width, height);
+	}
+	indexMoved = false;
+}
+
+
+// Collides all particles in contact, using the broadphase to skip pairs that are too far apart. Only pairs with an awake
+// particle are tested, as sleeping particles have not moved since they last touched.
+void Environment::resolveContacts() {
+	CPPARTICLES_TRACE_SCOPE("collide");
+	int awake = particles.getAwakeCount();
+	if (broadphase == BRUTE_FORCE) {
+		long count = particles.getCount();
+		pairTests += awake * (count - 1) - static_cast<long>(awake) * (awake - 1) / 2;
+		for (int i = 0; i < awake; i++) {
+			for (int x = i + 1; x < particles.getCount(); x++) {
+				collidePair(i, x, awake);
+			}
 		}
-		// Allows interaction with other particles.
-		for (int x = i + 1; x < particles.size(); x++) {
-			Particle *otherParticle = particles[x];
-			if (allowCollide) {
-				particle->collide(otherParticle);
+		return;
+	}
+
+	// Pairs are visited in the same order as the brute force loop, but are found from the positions at the start of the
+	// pass, so a contact made by a push during the pass is left to the next update.
+	if (broadphase == SWEEP_AND_PRUNE) {
+		sweepAndPrune.update(particles, awake);
+		for (int i = 0; i < awake; i++) {
+			const int *partners = sweepAndPrune.getNeighbours(i);
+			int total = sweepAndPrune.getNeighbourCount(i);
+			pairTests += total;
+			for (int k = 0; k < total; k++) {
+				int j = partners[k];
+				collidePair(i, j, awake);
 			}
-			if (allowAttract) {
-				particle->attract(otherParticle);
+		}
+		return;
+	}
+
+	// Pairs are visited in the same order as the brute force loop, and particles moved by a contact are moved in the
+	// grid straight away, so both methods resolve exactly the same contacts.
+	grid.build(particles);
+	for (int i = 0; i < awake; i++) {
+		int last = i;
+		bool moved = true;
+		while (moved) {
+			moved = false;
+			int cell = grid.getCell(i);
+			grid.neighbours(i, last, candidates);
+			for (int k = 0; k < candidates.size(); k++) {
+				last = candidates[k];
+				pairTests++;
+				collidePair(i, last, awake);
+				grid.update(i, particles.xs[i], particles.ys[i]);
+				grid.update(last, particles.xs[last], particles.ys[last]);
+				// The particle has left its cell, so its remaining neighbours must be found again.
+				if (grid.getCell(i) != cell) {
+					moved = true;
+					break;
+				}
 			}
-			if (allowCombine) {
-				particle->combine(otherParticle);
+		}
+	}
+}
+
+
+// Runs the steps requested by stepAsync on the stepping thread, one at a time, until the environment is destroyed.
+void Environment::runSteps() {
+	CPPARTICLES_TRACE_THREAD("stepper");
+	std::unique_lock<std::mutex> lock(stepMutex);
+	while (true) {
+		stepChanged.wait(lock, [&] { return stepRequested || stopping; });
+		if (!stepRequested) {
+			return;
+		}
+		std::promise<void> promise = std::move(stepPromise);
+		lock.unlock();
+		try {
+			update(stepDt);
+			promise.set_value();
+		} catch (...) {
+			promise.set_exception(std::current_exception());
+		}
+		lock.lock();
+		stepRequested = false;
+		stepChanged.notify_all();
+	}
+}
+
+
+// Advances the particles and springs by one step of dt frames.
+void Environment::step(float dt, std::chrono::steady_clock::time_point &lapStart) {
+	// A step backwards, or of no length, leaves the particles where they are, apart from pushing apart any in contact.
+	if (!(dt > 0)) {
+		dt = 0;
+	}
+	// Explicit Euler accelerates the particles after moving them, and velocity Verlet half before and half after.
+	float early = integrator == EXPLICIT_EULER ? 0 : integrator == VELOCITY_VERLET ? 0.5 : 1;
+	float ax = sin(acceleration.angle) * acceleration.speed * dt;
+	float ay = -cos(acceleration.angle) * acceleration.speed * dt;
+	Integration integration;
+	integration.accelerate = allowAccelerate;
+	integration.move = allowMove;
+	integration.drag = allowDrag;
+	integration.bounce = allowBounce;
+	integration.split = allowAccelerate && early != 1;
+	integration.ax = ax * early;
+	integration.ay = ay * early;
+	integration.lateAx = ax * (1 - early);
+	integration.lateAy = ay * (1 - early);
+	integration.dt = dt;
+	integration.drags = particles.drags.data();
+	integration.width = width;
+	integration.height = height;
+	IntegrationKernel integrate = selectIntegrationKernel(integration, simdLevel);
+	int count = particles.getCount();
+	// Sleeping particles are left where they are.
+	int awake = particles.getAwakeCount();
+	// Forces are written for steps of one frame, so any other step, or integrator, has their effect on the velocities
+	// scaled or held back.
+	bool scaleForces = dt != 1 || integrator != SEMI_IMPLICIT_EULER;
+	auto applyDeferred = [&]() {
+		for (int i = 0; i < count; i++) {
+			particles.vxs[i] += particles.deferredVxs[i];
+			particles.vys[i] += particles.deferredVys[i];
+			particles.deferredVxs[i] = 0;
+			particles.deferredVys[i] = 0;
+		}
+	};
+	{
+		CPPARTICLES_TRACE_SCOPE("integrate");
+		// Each particle's drag is the fraction of its velocity kept over a frame.
+		if (allowDrag && dt != 1) {
+			stepDrags.resize(awake);
+			for (int i = 0; i < awake; i++) {
+				stepDrags[i] = pow(particles.drags[i], dt);
 			}
+			integration.drags = stepDrags.data();
+		}
+		if (integrator == VELOCITY_VERLET) {
+			applyDeferred();
+		}
+		if (pool) {
+			pool->run((awake + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK, [&](int task, int) {
+				integrate(particles, task * PARTICLE_CHUNK, std::min(awake, (task + 1) * PARTICLE_CHUNK), integration);
+			});
+		} else {
+			integrate(particles, 0, awake, integration);
+		}
+		if (integrator == EXPLICIT_EULER) {
+			applyDeferred();
 		}
 	}
-	for (int i = 0; i < springs.size(); i++) {
-		Spring *spring = springs[i];
-		spring->update();
+	if (collectStats) {
+		lap(PHASE_INTEGRATE, lapStart);
+	}
+	// Allows interaction with other particles.
+	if (allowAttract) {
+		if (scaleForces) {
+			beginForces();
+		}
+		attractParticles();
+		if (scaleForces) {
+			endForces(dt);
+		}
+		if (collectStats) {
+			lap(PHASE_ATTRACT, lapStart);
+		}
+	}
+	if (allowCollide) {
+		if (pool) {
+			collideParallel();
+		} else {
+			resolveContacts();
+		}
+		if (collectStats) {
+			lap(PHASE_COLLIDE, lapStart);
+		}
+	}
+	if (allowCombine) {
+		mergeParticles();
+		if (collectStats) {
+			lap(PHASE_COMBINE, lapStart);
+		}
+	}
+	{
+		CPPARTICLES_TRACE_SCOPE("springs");
+		if (springSolver == SPRING_CONSTRAINTS) {
+			projectSprings(dt);
+		} else {
+			if (scaleForces) {
+				beginForces();
+			}
+			// Springs between two sleeping particles are skipped. The threaded update takes the springs a color at a
+			// time.
+			awake = particles.getAwakeCount();
+			auto updateSpring = [&](int k) {
+				if (particles.ids.getIndex(springs.p1s[k]) < awake || particles.ids.getIndex(springs.p2s[k]) < awake) {
+					Spring(&springs, k).update();
+				}
+			};
+			if (pool) {
+				springs.color();
+				for (int color = 0; color < springs.getColorCount(); color++) {
+					forEachInColor(color, updateSpring);
+				}
+			} else {
+				for (int k = 0; k < springs.getCount(); k++) {
+					updateSpring(k);
+				}
+			}
+			if (scaleForces) {
+				endForces(dt);
+			}
+		}
+	}
+	if (collectStats) {
+		lap(PHASE_SPRINGS, lapStart);
+	}
+}
+
+
+// Puts every island of particles that has rested for the sleep steps to sleep, and wakes every sleeping island that a
+// moving particle has touched, or that has been sped up by attraction or by hand. An island is a group of resting
+// particles joined by contacts and springs, so a disturbance only wakes the group it reaches.
+void Environment::updateSleep() {
+	CPPARTICLES_TRACE_SCOPE("sleep");
+	int count = particles.getCount();
+	int awake = particles.getAwakeCount();
+	float limit = sleepSpeed * sleepSpeed;
+	for (int i = 0; i < awake; i++) {
+		float speed2 = particles.vxs[i] * particles.vxs[i] + particles.vys[i] * particles.vys[i];
+		particles.stillSteps[i] = speed2 < limit ? particles.stillSteps[i] + 1 : 0;
+	}
+	// Sleeping particles are kept stopped, so pushes too small to wake them are discarded.
+	wakingIslands.resize(particles.ids.getSlotCount(), false);
+	bool waking = false;
+	for (int i = awake; i < count; i++) {
+		if (particles.vxs[i] * particles.vxs[i] + particles.vys[i] * particles.vys[i] >= limit) {
+			wakingIslands[particles.islands[i]] = true;
+			waking = true;
+		} else {
+			particles.vxs[i] = 0;
+			particles.vys[i] = 0;
+		}
+	}
+
+	// Joins two resting particles into an island. A moving particle joined to a sleeping one wakes its island, but a
+	// resting one may lie on it without waking it. Contacts with particles removed by combining are ignored.
+	groups.reset(awake);
+	auto join = [&](int i, int j) {
+		if (i < 0 || j < 0 || (i >= awake && j >= awake)) {
+			return;
+		}
+		bool movingI = i < awake && particles.stillSteps[i] == 0;
+		bool movingJ = j < awake && particles.stillSteps[j] == 0;
+		if (i >= awake || j >= awake) {
+			if (movingI || movingJ) {
+				wakingIslands[particles.islands[i >= awake ? i : j]] = true;
+				waking = true;
+			}
+		} else if (!movingI && !movingJ) {
+			groups.unite(i, j);
+		}
+	};
+	for (int k = 0; k < contacts.size(); k++) {
+		SlotId a = contacts[k].first;
+		SlotId b = contacts[k].second;
+		join(particles.ids.isLive(a) ? particles.ids.getIndex(a.slot) : -1, particles.ids.isLive(b) ? particles.ids.getIndex(b.slot) : -1);
+	}
+	for (int k = 0; k < springs.getCount(); k++) {
+		join(particles.ids.getIndex(springs.p1s[k]), particles.ids.getIndex(springs.p2s[k]));
+	}
+
+	// An island falls asleep once every particle in it has rested for long enough. Each island is named after the slot
+	// of one of its particles, and its particles are stopped so that they stay asleep.
+	islandStill.assign(awake, INT_MAX);
+	for (int i = 0; i < awake; i++) {
+		int &still = islandStill[groups.find(i)];
+		still = std::min(still, particles.stillSteps[i]);
+	}
+	falling.clear();
+	for (int i = 0; i < awake; i++) {
+		int root = groups.find(i);
+		if (islandStill[root] >= sleepSteps) {
+			particles.islands[i] = particles.ids.getSlot(root);
+			falling.push_back(particles.ids.getSlot(i));
+		}
+	}
+	// Waking only moves particles from the sleeping end, so the slots of the falling particles are still awake.
+	if (waking) {
+		wakeIslands();
+	}
+	for (int k = 0; k < falling.size(); k++) {
+		int i = particles.ids.getIndex(falling[k]);
+		particles.vxs[i] = 0;
+		particles.vys[i] = 0;
+		particles.sleep(i);
+	}
+}
+
+
+// Wakes every sleeping particle in the islands marked for waking, and clears the marks.
+void Environment::wakeIslands() {
+	int first = particles.getAwakeCount();
+	for (int i = first; i < particles.getCount(); i++) {
+		// The particle swapped into place has already been checked.
+		if (wakingIslands[particles.islands[i]]) {
+			particles.stillSteps[particles.wake(i)] = 0;
+		}
+	}
+	for (int i = first; i < particles.getAwakeCount(); i++) {
+		wakingIslands[particles.islands[i]] = false;
+	}
+}
+
+
+// Sets whether particles that have rested for the sleep steps are put to sleep. Turning sleeping off wakes every
+// particle.
+void Environment::setAllowSleep(bool setting) {
+	allowSleep = setting;
+	if (!setting) {
+		particles.wakeAll();
+		particles.stillSteps.assign(particles.getCount(), 0);
+	}
+}
+
+
+// Sets whether a snapshot of the particles and springs is published at the end of every update, to be read with
+// getSnapshot. Turning snapshots on publishes the current state straight away.
+void Environment::setPublishSnapshots(bool setting) {
+	publishSnapshots = setting;
+	if (setting) {
+		publishSnapshot();
+	}
+}
+
+
+// Sets the instruction set used to integrate particles. Levels the processor does not support fall back to the widest
+// one it does.
+void Environment::setSimdLevel(SimdLevel level) {
+	simdLevel = std::min(level, detectSimdLevel());
+}
+
+
+// Sets the number of threads used to update the environment. With more than one thread, contacts between particles
+// are resolved simultaneously rather than one after another, which gives slightly different results to the single
+// threaded update, but the same results for any number of threads.
+void Environment::setThreadCount(int count) {
+	pool.reset(count > 1 ? new ThreadPool(count) : nullptr);
+	workerCandidates.resize(std::max(count, 1));
+}
+
+
+// Starts an update of dt frames on the stepping thread and returns a future that is ready when it has finished. If a
+// step is already running, waits for it to finish first. Snapshots are turned on, so the last finished step can be read
+// with getSnapshot while the next one runs. Nothing else may be called on the environment, or its particles and
+// springs, until the future is ready.
+std::future<void> Environment::stepAsync(float dt) {
+	if (!publishSnapshots) {
+		setPublishSnapshots(true);
+	}
+	std::unique_lock<std::mutex> lock(stepMutex);
+	if (!stepThread.joinable()) {
+		stepThread = std::thread(&Environment::runSteps, this);
+	}
+	stepChanged.wait(lock, [&] { return !stepRequested; });
+	stepPromise = std::promise<void>();
+	stepDt = dt;
+	std::future<void> result = stepPromise.get_future();
+	stepRequested = true;
+	stepChanged.notify_all();
+	return result;
+}
+
+
+// Updates all particles and springs in the environment over dt frames. If substeps are allowed, the update is divided
+// into as many equal steps as it takes for no particle to move further than the Courant number times its size in one
+// step, so that fast particles do not pass through each other. With stats turned on, each phase of the update is timed
+// and the stats are passed to the callback, if there is one.
+void Environment::update(float dt) {
+	CPPARTICLES_TRACE_SCOPE("update");
+	std::chrono::steady_clock::time_point start, lapStart;
+	long allocations = 0;
+	if (collectStats) {
+		stats = StepStats();
+		allocations = alignedAllocations.load(std::memory_order_relaxed);
+		start = std::chrono::steady_clock::now();
+		lapStart = start;
+	}
+	pairTests = 0;
+	collisions = 0;
+	contacts.clear();
+	contactEvents.clear();
+	mergeEvents.clear();
+	int count = particles.getCount();
+	int substeps = countSubsteps(dt);
+	for (int substep = 0; substep < substeps; substep++) {
+		step(dt / substeps, lapStart);
+	}
+	if (allowSleep) {
+		updateSleep();
+		if (collectStats) {
+			lap(PHASE_SLEEP, lapStart);
+		}
+	}
+	indexMoved = true;
+	steps++;
+	if (publishSnapshots) {
+		publishSnapshot();
+		if (collectStats) {
+			lap(PHASE_PUBLISH, lapStart);
+		}
+	}
+	if (recorder) {
+		recorder->record(steps, particles);
+		if (collectStats) {
+			lap(PHASE_RECORD, lapStart);
+		}
+	}
+	if (collectStats) {
+		stats.step = steps;
+		stats.substeps = substeps;
+		stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		stats.pairTests = pairTests;
+		stats.collisions = collisions;
+		stats.merges = count - particles.getCount();
+		stats.particles = particles.getCount();
+		stats.springs = springs.getCount();
+		stats.sleeping = particles.getCount() - particles.getAwakeCount();
+		stats.allocations = alignedAllocations.load(std::memory_order_relaxed) - allocations;
+		if (statsCallback) {
+			statsCallback(stats);
+		}
+	}
+}
+
+
+// Wakes a sleeping particle, along with the rest of its island. A sleeping particle sped up by hand wakes by itself at
+// the next update, but one only moved by hand stays asleep until it is woken with this.
+void Environment::wake(Particle particle) {
+	if (particle && isAsleep(particle)) {
+		wakingIslands.resize(particles.ids.getSlotCount(), false);
+		wakingIslands[particles.islands[particle.getIndex()]] = true;
+		wakeIslands();
 	}
 }
@@ -0,0 +1,110 @@
+// Contains member functions of the UniformGrid class.
+// Buckets particles into square cells so that only particles in neighbouring cells are tested against each other.
+#include <algorithm>
+#include "../include/grid.hpp"
+#include "../include/tracer.hpp"
+
+
+// Rebuilds the grid around the particles, with cells at least as wide as the largest possible contact distance.
+void UniformGrid::build(ParticleStore const& particles) {
+	CPPARTICLES_TRACE_SCOPE("build grid");
+	int count = particles.xs.size();
+	float maxSize = 0;
+	float maxX = 0;
+	float maxY = 0;
+	minX = 0;
+	minY = 0;
+	for (int i = 0; i < count; i++) {
+		float x = particles.xs[i];
+		float y = particles.ys[i];
+		maxSize = std::max(maxSize, particles.sizes[i]);
+		if (i == 0 || x < minX) minX = x;
+		if (i == 0 || y < minY) minY = y;
+		if (i == 0 || x > maxX) maxX = x;
+		if (i == 0 || y > maxY) maxY = y;
+	}
+
+	// Two particles can only touch if they are less than the sum of their sizes apart.
+	cellSize = maxSize > 0 ? 2 * maxSize : 1;
+	// Widen the cells when particles are spread thinly so the grid stays proportional to the particle count.
+	long long maxCells = 4 * (long long)count + 64;
+	while (true) {
+		columns = static_cast<int>((maxX - minX) / cellSize) + 1;
+		rows = static_cast<int>((maxY - minY) / cellSize) + 1;
+		if (columns > 0 && rows > 0 && (long long)columns * rows <= maxCells) {
+			break;
+		}
+		cellSize *= 2;
+	}
+
+	heads.assign(columns * rows, -1);
+	next.assign(count, -1);
+	prev.assign(count, -1);
+	cells.assign(count, 0);
+	for (int i = 0; i < count; i++) {
+		link(i, cellOf(particles.xs[i], particles.ys[i]));
+	}
+}
+
+
+// Returns the cell containing the coordinates (x, y). Coordinates outside the grid are clamped to the border cells.
+int UniformGrid::cellOf(float x, float y) {
+	float cx = (x - minX) / cellSize;
+	float cy = (y - minY) / cellSize;
+	int column = cx > 0 ? (cx < columns - 1 ? static_cast<int>(cx) : columns - 1) : 0;
+	int row = cy > 0 ? (cy < rows - 1 ? static_cast<int>(cy) : rows - 1) : 0;
+	return row * columns + column;
+}
+
+
+// Adds a particle to the front of a cell's list.
+void UniformGrid::link(int index, int cell) {
+	cells[index] = cell;
+	prev[index] = -1;
+	next[index] = heads[cell];
+	if (heads[cell] != -1) {
+		prev[heads[cell]] = index;
+	}
+	heads[cell] = index;
+}
+
+
+// Fills result with the particles after the given index in the cell of the particle and its eight neighbours, in ascending order.
+void UniformGrid::neighbours(int index, int after, AlignedVector<int> &result) const {
+	result.clear();
+	int column = cells[index] % columns;
+	int row = cells[index] / columns;
+	for (int r = std::max(row - 1, 0); r <= std::min(row + 1, rows - 1); r++) {
+		for (int c = std::max(column - 1, 0); c <= std::min(column + 1, columns - 1); c++) {
+			for (int k = heads[r * columns + c]; k != -1; k = next[k]) {
+				if (k > after) {
+					result.push_back(k);
+				}
+			}
+		}
+	}
+	std::sort(result.begin(), result.end());
+}
+
+
+// Removes a particle from its cell's list.
+void UniformGrid::unlink(int index) {
+	if (prev[index] != -1) {
+		next[prev[index]] = next[index];
+	} else {
+		heads[cells[index]] = next[index];
+	}
+	if (next[index] != -1) {
+		prev[next[index]] = prev[index];
+	}
+}
+
+
+// Moves a particle to the cell containing its new coordinates (x, y).
+void UniformGrid::update(int index, float x, float y) {
+	int cell = cellOf(x, y);
+	if (cell != cells[index]) {
+		unlink(index);
+		link(index, cell);
+	}
+}
@@ -0,0 +1,391 @@
+// Contains the batch particle kernels.
+// Integrates many particles at once with the widest instruction set the processor supports.
+#include <utility>
+#include "../include/kernels.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPPARTICLES_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Every kernel applies the same operations in the same order and never fuses a multiply with an add, so all
+// instruction sets produce bit-identical results. Doubling is written as an addition for the same reason.
+
+
+// Integrates the particles from begin to end one at a time, applying only the stages in features.
+template <int features>
+static void integrateScalar(ParticleStore &particles, int begin, int end, Integration const& integration) {
+	float *xs = particles.xs.data();
+	float *ys = particles.ys.data();
+	float *vxs = particles.vxs.data();
+	float *vys = particles.vys.data();
+	const float *drags = integration.drags;
+	const float *sizes = particles.sizes.data();
+	const float *elasticities = particles.elasticities.data();
+	for (int i = begin; i < end; i++) {
+		float x = xs[i];
+		float y = ys[i];
+		float vx = vxs[i];
+		float vy = vys[i];
+		if constexpr ((features & INTEGRATE_ACCELERATE) != 0) {
+			vx += integration.ax;
+			vy += integration.ay;
+		}
+		if constexpr ((features & INTEGRATE_MOVE) != 0) {
+			x += vx * integration.dt;
+			y += vy * integration.dt;
+		}
+		if constexpr ((features & INTEGRATE_SPLIT) != 0) {
+			vx += integration.lateAx;
+			vy += integration.lateAy;
+		}
+		if constexpr ((features & INTEGRATE_DRAG) != 0) {
+			vx *= drags[i];
+			vy *= drags[i];
+		}
+		if constexpr ((features & INTEGRATE_BOUNCE) != 0) {
+			float size = sizes[i];
+			float e = elasticities[i];
+			float right = integration.width - size;
+			float bottom = integration.height - size;
+			// Particle hits the right or left boundary:
+			if (x > right) {
+				x = (right + right) - x;
+				vx = -vx * e;
+				vy *= e;
+			} else if (x < size) {
+				x = (size + size) - x;
+				vx = -vx * e;
+				vy *= e;
+			}
+			// Particle hits the bottom or top boundary:
+			if (y > bottom) {
+				y = (bottom + bottom) - y;
+				vx *= e;
+				vy = -vy * e;
+			} else if (y < size) {
+				y = (size + size) - y;
+				vx *= e;
+				vy = -vy * e;
+			}
+		}
+		xs[i] = x;
+		ys[i] = y;
+		vxs[i] = vx;
+		vys[i] = vy;
+	}
+}
+
+
+#ifdef CPPARTICLES_X86_SIMD
+
+// Selects b where the mask is set, otherwise a.
+__attribute__((target("sse2")))
+static inline __m128 select4(__m128 a, __m128 b, __m128 mask) {
+	return _mm_or_ps(_mm_andnot_ps(mask, a), _mm_and_ps(mask, b));
+}
+
+
+// Integrates the particles from begin to end four at a time with SSE2, applying only the stages in features.
+template <int features>
+__attribute__((target("sse2")))
+static void integrateSse(ParticleStore &particles, int begin, int end, Integration const& integration) {
+	float *xs = particles.xs.data();
+	float *ys = particles.ys.data();
+	float *vxs = particles.vxs.data();
+	float *vys = particles.vys.data();
+	const float *drags = integration.drags;
+	const float *sizes = particles.sizes.data();
+	const float *elasticities = particles.elasticities.data();
+	const __m128 ax = _mm_set1_ps(integration.ax);
+	const __m128 ay = _mm_set1_ps(integration.ay);
+	const __m128 lateAx = _mm_set1_ps(integration.lateAx);
+	const __m128 lateAy = _mm_set1_ps(integration.lateAy);
+	const __m128 dt = _mm_set1_ps(integration.dt);
+	const __m128 width = _mm_set1_ps(integration.width);
+	const __m128 height = _mm_set1_ps(integration.height);
+	const __m128 one = _mm_set1_ps(1);
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	int i = begin;
+	for (; i + 4 <= end; i += 4) {
+		__m128 x = _mm_loadu_ps(xs + i);
+		__m128 y = _mm_loadu_ps(ys + i);
+		__m128 vx = _mm_loadu_ps(vxs + i);
+		__m128 vy = _mm_loadu_ps(vys + i);
+		if constexpr ((features & INTEGRATE_ACCELERATE) != 0) {
+			vx = _mm_add_ps(vx, ax);
+			vy = _mm_add_ps(vy, ay);
+		}
+		if constexpr ((features & INTEGRATE_MOVE) != 0) {
+			x = _mm_add_ps(x, _mm_mul_ps(vx, dt));
+			y = _mm_add_ps(y, _mm_mul_ps(vy, dt));
+		}
+		if constexpr ((features & INTEGRATE_SPLIT) != 0) {
+			vx = _mm_add_ps(vx, lateAx);
+			vy = _mm_add_ps(vy, lateAy);
+		}
+		if constexpr ((features & INTEGRATE_DRAG) != 0) {
+			__m128 drag = _mm_loadu_ps(drags + i);
+			vx = _mm_mul_ps(vx, drag);
+			vy = _mm_mul_ps(vy, drag);
+		}
+		if constexpr ((features & INTEGRATE_BOUNCE) != 0) {
+			__m128 size = _mm_loadu_ps(sizes + i);
+			__m128 e = _mm_loadu_ps(elasticities + i);
+			__m128 right = _mm_sub_ps(width, size);
+			__m128 bottom = _mm_sub_ps(height, size);
+			__m128 hitRight = _mm_cmpgt_ps(x, right);
+			__m128 hitLeft = _mm_andnot_ps(hitRight, _mm_cmplt_ps(x, size));
+			x = select4(x, _mm_sub_ps(_mm_add_ps(right, right), x), hitRight);
+			x = select4(x, _mm_sub_ps(_mm_add_ps(size, size), x), hitLeft);
+			__m128 hitX = _mm_or_ps(hitRight, hitLeft);
+			__m128 ex = select4(one, e, hitX);
+			vx = _mm_mul_ps(_mm_xor_ps(vx, _mm_and_ps(hitX, sign)), ex);
+			vy = _mm_mul_ps(vy, ex);
+			__m128 hitBottom = _mm_cmpgt_ps(y, bottom);
+			__m128 hitTop = _mm_andnot_ps(hitBottom, _mm_cmplt_ps(y, size));
+			y = select4(y, _mm_sub_ps(_mm_add_ps(bottom, bottom), y), hitBottom);
+			y = select4(y, _mm_sub_ps(_mm_add_ps(size, size), y), hitTop);
+			__m128 hitY = _mm_or_ps(hitBottom, hitTop);
+			__m128 ey = select4(one, e, hitY);
+			vx = _mm_mul_ps(vx, ey);
+			vy = _mm_mul_ps(_mm_xor_ps(vy, _mm_and_ps(hitY, sign)), ey);
+		}
+		_mm_storeu_ps(xs + i, x);
+		_mm_storeu_ps(ys + i, y);
+		_mm_storeu_ps(vxs + i, vx);
+		_mm_storeu_ps(vys + i, vy);
+	}
+	integrateScalar<features>(particles, i, end, integration);
+}
+
+
+// Integrates the particles from begin to end eight at a time with AVX2, applying only the stages in features.
+template <int features>
+__attribute__((target("avx2")))
+static void integrateAvx2(ParticleStore &particles, int begin, int end, Integration const& integration) {
+	float *xs = particles.xs.data();
+	float *ys = particles.ys.data();
+	float *vxs = particles.vxs.data();
+	float *vys = particles.vys.data();
+	const float *drags = integration.drags;
+	const float *sizes = particles.sizes.data();
+	const float *elasticities = particles.elasticities.data();
+	const __m256 ax = _mm256_set1_ps(integration.ax);
+	const __m256 ay = _mm256_set1_ps(integration.ay);
+	const __m256 lateAx = _mm256_set1_ps(integration.lateAx);
+	const __m256 lateAy = _mm256_set1_ps(integration.lateAy);
+	const __m256 dt = _mm256_set1_ps(integration.dt);
+	const __m256 width = _mm256_set1_ps(integration.width);
+	const __m256 height = _mm256_set1_ps(integration.height);
+	const __m256 one = _mm256_set1_ps(1);
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	int i = begin;
+	for (; i + 8 <= end; i += 8) {
+		__m256 x = _mm256_loadu_ps(xs + i);
+		__m256 y = _mm256_loadu_ps(ys + i);
+		__m256 vx = _mm256_loadu_ps(vxs + i);
+		__m256 vy = _mm256_loadu_ps(vys + i);
+		if constexpr ((features & INTEGRATE_ACCELERATE) != 0) {
+			vx = _mm256_add_ps(vx, ax);
+			vy = _mm256_add_ps(vy, ay);
+		}
+		if constexpr ((features & INTEGRATE_MOVE) != 0) {
+			x = _mm256_add_ps(x, _mm256_mul_ps(vx, dt));
+			y = _mm256_add_ps(y, _mm256_mul_ps(vy, dt));
+		}
+		if constexpr ((features & INTEGRATE_SPLIT) != 0) {
+			vx = _mm256_add_ps(vx, lateAx);
+			vy = _mm256_add_ps(vy, lateAy);
+		}
+		if constexpr ((features & INTEGRATE_DRAG) != 0) {
+			__m256 drag = _mm256_loadu_ps(drags + i);
+			vx = _mm256_mul_ps(vx, drag);
+			vy = _mm256_mul_ps(vy, drag);
+		}
+		if constexpr ((features & INTEGRATE_BOUNCE) != 0) {
+			__m256 size = _mm256_loadu_ps(sizes + i);
+			__m256 e = _mm256_loadu_ps(elasticities + i);
+			__m256 right = _mm256_sub_ps(width, size);
+			__m256 bottom = _mm256_sub_ps(height, size);
+			__m256 hitRight = _mm256_cmp_ps(x, right, _CMP_GT_OQ);
+			__m256 hitLeft = _mm256_andnot_ps(hitRight, _mm256_cmp_ps(x, size, _CMP_LT_OQ));
+			x = _mm256_blendv_ps(x, _mm256_sub_ps(_mm256_add_ps(right, right), x), hitRight);
+			x = _mm256_blendv_ps(x, _mm256_sub_ps(_mm256_add_ps(size, size), x), hitLeft);
+			__m256 hitX = _mm256_or_ps(hitRight, hitLeft);
+			__m256 ex = _mm256_blendv_ps(one, e, hitX);
+			vx = _mm256_mul_ps(_mm256_xor_ps(vx, _mm256_and_ps(hitX, sign)), ex);
+			vy = _mm256_mul_ps(vy, ex);
+			__m256 hitBottom = _mm256_cmp_ps(y, bottom, _CMP_GT_OQ);
+			__m256 hitTop = _mm256_andnot_ps(hitBottom, _mm256_cmp_ps(y, size, _CMP_LT_OQ));
+			y = _mm256_blendv_ps(y, _mm256_sub_ps(_mm256_add_ps(bottom, bottom), y), hitBottom);
+			y = _mm256_blendv_ps(y, _mm256_sub_ps(_mm256_add_ps(size, size), y), hitTop);
+			__m256 hitY = _mm256_or_ps(hitBottom, hitTop);
+			__m256 ey = _mm256_blendv_ps(one, e, hitY);
+			vx = _mm256_mul_ps(vx, ey);
+			vy = _mm256_mul_ps(_mm256_xor_ps(vy, _mm256_and_ps(hitY, sign)), ey);
+		}
+		_mm256_storeu_ps(xs + i, x);
+		_mm256_storeu_ps(ys + i, y);
+		_mm256_storeu_ps(vxs + i, vx);
+		_mm256_storeu_ps(vys + i, vy);
+	}
+	// Clears the upper halves of the registers, which would otherwise slow every SSE instruction run after this.
+	_mm256_zeroupper();
+	integrateScalar<features>(particles, i, end, integration);
+}
+
+
+// Flips the sign of a where the mask is set.
+__attribute__((target("avx512f")))
+static inline __m512 negate16(__m512 a, __mmask16 mask) {
+	__m512i bits = _mm512_castps_si512(a);
+	return _mm512_castsi512_ps(_mm512_mask_xor_epi32(bits, mask, bits, _mm512_set1_epi32(0x80000000)));
+}
+
+
+// Integrates the particles from begin to end sixteen at a time with AVX-512, applying only the stages in features.
+template <int features>
+__attribute__((target("avx512f")))
+static void integrateAvx512(ParticleStore &particles, int begin, int end, Integration const& integration) {
+	float *xs = particles.xs.data();
+	float *ys = particles.ys.data();
+	float *vxs = particles.vxs.data();
+	float *vys = particles.vys.data();
+	const float *drags = integration.drags;
+	const float *sizes = particles.sizes.data();
+	const float *elasticities = particles.elasticities.data();
+	const __m512 ax = _mm512_set1_ps(integration.ax);
+	const __m512 ay = _mm512_set1_ps(integration.ay);
+	const __m512 lateAx = _mm512_set1_ps(integration.lateAx);
+	const __m512 lateAy = _mm512_set1_ps(integration.lateAy);
+	const __m512 dt = _mm512_set1_ps(integration.dt);
+	const __m512 width = _mm512_set1_ps(integration.width);
+	const __m512 height = _mm512_set1_ps(integration.height);
+	const __m512 one = _mm512_set1_ps(1);
+	int i = begin;
+	for (; i + 16 <= end; i += 16) {
+		__m512 x = _mm512_loadu_ps(xs + i);
+		__m512 y = _mm512_loadu_ps(ys + i);
+		__m512 vx = _mm512_loadu_ps(vxs + i);
+		__m512 vy = _mm512_loadu_ps(vys + i);
+		if constexpr ((features & INTEGRATE_ACCELERATE) != 0) {
+			vx = _mm512_add_ps(vx, ax);
+			vy = _mm512_add_ps(vy, ay);
+		}
+		if constexpr ((features & INTEGRATE_MOVE) != 0) {
+			x = _mm512_add_ps(x, _mm512_mul_ps(vx, dt));
+			y = _mm512_add_ps(y, _mm512_mul_ps(vy, dt));
+		}
+		if constexpr ((features & INTEGRATE_SPLIT) != 0) {
+			vx = _mm512_add_ps(vx, lateAx);
+			vy = _mm512_add_ps(vy, lateAy);
+		}
+		if constexpr ((features & INTEGRATE_DRAG) != 0) {
+			__m512 drag = _mm512_loadu_ps(drags + i);
+			vx = _mm512_mul_ps(vx, drag);
+			vy = _mm512_mul_ps(vy, drag);
+		}
+		if constexpr ((features & INTEGRATE_BOUNCE) != 0) {
+			__m512 size = _mm512_loadu_ps(sizes + i);
+			__m512 e = _mm512_loadu_ps(elasticities + i);
+			__m512 right = _mm512_sub_ps(width, size);
+			__m512 bottom = _mm512_sub_ps(height, size);
+			__mmask16 hitRight = _mm512_cmp_ps_mask(x, right, _CMP_GT_OQ);
+			__mmask16 hitLeft = ~hitRight & _mm512_cmp_ps_mask(x, size, _CMP_LT_OQ);
+			x = _mm512_mask_blend_ps(hitRight, x, _mm512_sub_ps(_mm512_add_ps(right, right), x));
+			x = _mm512_mask_blend_ps(hitLeft, x, _mm512_sub_ps(_mm512_add_ps(size, size), x));
+			__mmask16 hitX = hitRight | hitLeft;
+			__m512 ex = _mm512_mask_blend_ps(hitX, one, e);
+			vx = _mm512_mul_ps(negate16(vx, hitX), ex);
+			vy = _mm512_mul_ps(vy, ex);
+			__mmask16 hitBottom = _mm512_cmp_ps_mask(y, bottom, _CMP_GT_OQ);
+			__mmask16 hitTop = ~hitBottom & _mm512_cmp_ps_mask(y, size, _CMP_LT_OQ);
+			y = _mm512_mask_blend_ps(hitBottom, y, _mm512_sub_ps(_mm512_add_ps(bottom, bottom), y));
+			y = _mm512_mask_blend_ps(hitTop, y, _mm512_sub_ps(_mm512_add_ps(size, size), y));
+			__mmask16 hitY = hitBottom | hitTop;
+			__m512 ey = _mm512_mask_blend_ps(hitY, one, e);
+			vx = _mm512_mul_ps(vx, ey);
+			vy = _mm512_mul_ps(negate16(vy, hitY), ey);
+		}
+		_mm512_storeu_ps(xs + i, x);
+		_mm512_storeu_ps(ys + i, y);
+		_mm512_storeu_ps(vxs + i, vx);
+		_mm512_storeu_ps(vys + i, vy);
+	}
+	_mm256_zeroupper();
+	integrateScalar<features>(particles, i, end, integration);
+}
+
+#endif // CPPARTICLES_X86_SIMD
+
+
+// Returns the widest instruction set supported by both the processor and the compiler.
+SimdLevel detectSimdLevel() {
+#ifdef CPPARTICLES_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		return SIMD_AVX512;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		return SIMD_AVX2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return SIMD_SSE;
+	}
+#endif
+	return SIMD_SCALAR;
+}
+
+
+// Returns the kernel for the given feature set and instruction set, from tables holding one instantiation of each kernel
+// for every combination of stages.
+template <int... features>
+static IntegrationKernel selectKernel(int selected, SimdLevel level, std::integer_sequence<int, features...>) {
+#ifdef CPPARTICLES_X86_SIMD
+	static const IntegrationKernel avx512[] = {integrateAvx512<features>...};
+	static const IntegrationKernel avx2[] = {integrateAvx2<features>...};
+	static const IntegrationKernel sse[] = {integrateSse<features>...};
+	switch (level) {
+		case SIMD_AVX512:
+			return avx512[selected];
+		case SIMD_AVX2:
+			return avx2[selected];
+		case SIMD_SSE:
+			return sse[selected];
+		default:
+			break;
+	}
+#endif
+	static const IntegrationKernel scalar[] = {integrateScalar<features>...};
+	return scalar[selected];
+}
+
+
+// Returns the kernel that applies exactly the stages enabled in the integration, using the given instruction set. The
+// stages are compiled into the kernel, so it is selected once per update rather than tested for every particle.
+IntegrationKernel selectIntegrationKernel(Integration const& integration, SimdLevel level) {
+	int features = 0;
+	if (integration.accelerate) {
+		features |= INTEGRATE_ACCELERATE;
+	}
+	if (integration.move) {
+		features |= INTEGRATE_MOVE;
+	}
+	if (integration.drag) {
+		features |= INTEGRATE_DRAG;
+	}
+	if (integration.bounce) {
+		features |= INTEGRATE_BOUNCE;
+	}
+	if (integration.split) {
+		features |= INTEGRATE_SPLIT;
+	}
+	return selectKernel(features, level, std::make_integer_sequence<int, INTEGRATE_ALL + 1>());
+}
+
+
+// Accelerates, moves, drags and bounces the particles from begin to end, using the given instruction set.
+void integrateParticles(ParticleStore &particles, int begin, int end, Integration const& integration, SimdLevel level) {
+	selectIntegrationKernel(integration, level)(particles, begin, end, integration);
+}
@@ -11,100 +11,175 @@ Vector operator+(Vector const& v1, Vector const& v2) {
 }
 
 
-// Particle constructor.
-Particle::Particle(float x, float y, float size, float mass, float speed, float angle, float elasticity, float drag):
-x(x), y(y), size(size), mass(mass), speed(speed), angle(angle), elasticity(elasticity), drag(drag) {
+// Particle constructor. Refers to the particle currently at the index of the store.
+Particle::Particle(ParticleStore *store, int index):
+store(store), id(store->ids.getId(index)) {
+}
+
+
+// Particle constructor. Refers to the particle with the id in the store.
+Particle::Particle(ParticleStore *store, SlotId id):
+store(store), id(id) {
+}
+
+
+// Returns the direction the particle is moving in.
+float Particle::getAngle() {
+	int i = getIndex();
+	return atan2(store->vxs[i], -store->vys[i]);
+}
+
+
+// Returns the particle last combined into the particle, otherwise a null particle. Environment::update removes the
+// particles it combines, so the result then only compares equal to handles kept from before the update. Only the last
+// partner is kept; Environment::getMergeEvents lists every merge of the last update instead.
+Particle Particle::getCollideWith() {
+	SlotId other = store->collideWith[getIndex()];
+	return other.slot == -1 ? Particle() : Particle(store, other);
 }
 
 
 // Accelerates the particle.
 void Particle::accelerate(Vector vector) {
-	Vector velocity = Vector{angle, speed} + vector;
-	angle = velocity.angle;
-	speed = velocity.speed;
+	accelerate(sin(vector.angle) * vector.speed, -cos(vector.angle) * vector.speed);
 }
 
 
 // Attracts another particle to the particle.
-void Particle::attract(Particle *otherP) {
-	float dx = x - otherP->x;
-	float dy = y - otherP->y;
-	float distance = hypot(dx, dy);
-	float theta = atan2(dy, dx);
-	float force = 0.2 * mass * otherP->mass / pow(distance, 2);
-	accelerate(Vector {static_cast<float>(theta - 0.5 * M_PI), force / mass});
-	otherP->accelerate(Vector {static_cast<float>(theta + 0.5 * M_PI), force/otherP->mass});
+void Particle::attract(Particle otherP) {
+	ParticleStore &s = *store;
+	int i = getIndex();
+	int j = otherP.getIndex();
+	float dx = s.xs[i] - s.xs[j];
+	float dy = s.ys[i] - s.ys[j];
+	float distance2 = dx * dx + dy * dy;
+	float distance = sqrt(distance2);
+	// Force divided by distance, so that (dx, dy) does not need to be normalised.
+	float force = GRAVITATIONAL_CONSTANT * s.masses[i] * s.masses[j] / (distance2 * distance);
+	s.vxs[i] -= dx * force / s.masses[i];
+	s.vys[i] -= dy * force / s.masses[i];
+	s.vxs[j] += dx * force / s.masses[j];
+	s.vys[j] += dy * force / s.masses[j];
 }
 
 
-// Collides the particle with another particle.
-void Particle::collide(Particle *otherP) {
-	float dx = x - otherP->x;
-	float dy = y - otherP->y;
-	float distance = hypot(dx, dy);
-	
-	if (distance < (size + otherP->size)) {	// Collision detected.
-		float tangent = atan2(dy, dx);
-		float newAngle = 0.5 * M_PI + tangent;
-		float totalMass = mass + otherP->mass;
-		
-		Vector v1 = Vector{angle, speed * (mass - otherP->mass) / totalMass} + Vector{newAngle, 2 * otherP->speed * otherP->mass / totalMass};
-		Vector v2 = Vector{otherP->angle, otherP->speed * (otherP->mass - mass) / totalMass} + Vector{static_cast<float>(newAngle+M_PI), 2 * speed * mass / totalMass};
-		
-		angle = v1.angle;
-		speed = v1.speed;
-		otherP->angle = v2.angle;
-		otherP->speed = v2.speed;
-		
-		float newElasticity = elasticity * otherP->elasticity;
-		speed *= newElasticity;
-		otherP->speed *= newElasticity;
-		
-		float overlap = 0.5 * (size + otherP->size - distance + 1);
-		x += sin(newAngle) * overlap;
-		y -= cos(newAngle) * overlap;
-		otherP->x -= sin(newAngle) * overlap;
-		otherP->y += cos(newAngle) * overlap;
+// Collides the particle with another particle. Returns whether they were in contact.
+bool Particle::collide(Particle otherP) {
+	Collision collision;
+	if (!getCollision(otherP, collision)) {
+		return false;
 	}
+	ParticleStore &s = *store;
+	int i = getIndex();
+	int j = otherP.getIndex();
+	s.vxs[i] = collision.vx1;
+	s.vys[i] = collision.vy1;
+	s.vxs[j] = collision.vx2;
+	s.vys[j] = collision.vy2;
+	s.xs[i] += collision.dx;
+	s.ys[i] += collision.dy;
+	s.xs[j] -= collision.dx;
+	s.ys[j] -= collision.dy;
+	return true;
 }
 
 
 // Combines the particle with another particle.
-void Particle::combine(Particle *otherP) {
-	float dx = x - otherP->x;
-	float dy = y - otherP->y;
+void Particle::combine(Particle otherP) {
+	ParticleStore &s = *store;
+	int i = getIndex();
+	int j = otherP.getIndex();
+	float dx = s.xs[i] - s.xs[j];
+	float dy = s.ys[i] - s.ys[j];
 	float distance = hypot(dx, dy);
 	
-	if (distance < (size + otherP->size)) {	// Collision detected.
-		float totalMass = mass + otherP->mass;
-		x = (x * mass + otherP->x * otherP->mass) / totalMass;
-		y = (y * mass + otherP->y * otherP->mass) / totalMass;
-		Vector vector = Vector{angle, speed * mass / totalMass} + Vector{otherP->angle, otherP->speed * otherP->mass / totalMass};
-		angle = vector.angle;
-		speed = vector.speed * (elasticity * otherP->elasticity);
-		mass += otherP->mass;
-		collideWith = otherP;
+	if (distance < (s.sizes[i] + s.sizes[j])) {	// Collision detected.
+		float totalMass = s.masses[i] + s.masses[j];
+		float newElasticity = s.elasticities[i] * s.elasticities[j];
+		s.xs[i] = (s.xs[i] * s.masses[i] + s.xs[j] * s.masses[j]) / totalMass;
+		s.ys[i] = (s.ys[i] * s.masses[i] + s.ys[j] * s.masses[j]) / totalMass;
+		s.vxs[i] = (s.vxs[i] * s.masses[i] + s.vxs[j] * s.masses[j]) / totalMass * newElasticity;
+		s.vys[i] = (s.vys[i] * s.masses[i] + s.vys[j] * s.masses[j]) / totalMass * newElasticity;
+		s.masses[i] += s.masses[j];
+		s.collideWith[i] = s.ids.getId(j);
 	}
 }
 
 
 // Affects the speed of the particle with drag.
 void Particle::experienceDrag() {
-	speed *= drag;
+	int i = getIndex();
+	store->vxs[i] *= store->drags[i];
+	store->vys[i] *= store->drags[i];
 }
 
 
 // Updates the position of the particle.
 void Particle::move() {
-	x += sin(angle) * speed;
-	y -= cos(angle) * speed;
+	int i = getIndex();
+	store->xs[i] += store->vxs[i];
+	store->ys[i] += store->vys[i];
+}
+
+
+// Calculates the result of colliding the particle with another particle without applying it.
+// Returns whether the particles are in contact.
+bool Particle::getCollision(Particle otherP, Collision &collision) {
+	ParticleStore &s = *store;
+	int i = getIndex();
+	int j = otherP.getIndex();
+	float dx = s.xs[i] - s.xs[j];
+	float dy = s.ys[i] - s.ys[j];
+	float distance = hypot(dx, dy);
+	
+	if (distance >= (s.sizes[i] + s.sizes[j])) {
+		return false;
+	}
+	// Unit normal pointing from the other particle to this one. Particles at the same position separate along x.
+	float nx = distance > 0 ? dx / distance : 1;
+	float ny = distance > 0 ? dy / distance : 0;
+	float totalMass = s.masses[i] + s.masses[j];
+	float speed1 = hypot(s.vxs[i], s.vys[i]);
+	float speed2 = hypot(s.vxs[j], s.vys[j]);
+	
+	// Each particle keeps part of its own velocity and is pushed along the normal by the other's momentum.
+	float keep1 = (s.masses[i] - s.masses[j]) / totalMass;
+	float keep2 = (s.masses[j] - s.masses[i]) / totalMass;
+	float push1 = 2 * speed2 * s.masses[j] / totalMass;
+	float push2 = 2 * speed1 * s.masses[i] / totalMass;
+	float newElasticity = s.elasticities[i] * s.elasticities[j];
+	
+	collision.vx1 = (s.vxs[i] * keep1 + nx * push1) * newElasticity;
+	collision.vy1 = (s.vys[i] * keep1 + ny * push1) * newElasticity;
+	collision.vx2 = (s.vxs[j] * keep2 - nx * push2) * newElasticity;
+	collision.vy2 = (s.vys[j] * keep2 - ny * push2) * newElasticity;
+	
+	float overlap = 0.5 * (s.sizes[i] + s.sizes[j] - distance + 1);
+	collision.dx = nx * overlap;
+	collision.dy = ny * overlap;
+	return true;
 }
 
 
 // Moves the particle to coordinates (x, y).
 void Particle::moveTo(float moveX, float moveY) {
-	float dx = moveX - x;
-	float dy = moveY - y;
-	angle = atan2(dy, dx) + 0.5 * M_PI;
-	speed = hypot(dx, dy) * 0.1;
+	setVelocity((moveX - getX()) * 0.1, (moveY - getY()) * 0.1);
+}
+
+
+// Sets the direction the particle is moving in, keeping its speed.
+void Particle::setAngle(float a) {
+	float speed = getSpeed();
+	setVelocity(sin(a) * speed, -cos(a) * speed);
+}
+
+
+// Sets the speed of the particle, keeping its direction.
+void Particle::setSpeed(float s) {
+	float speed = getSpeed();
+	if (speed > 0) {
+		setVelocity(getVelocityX() * s / speed, getVelocityY() * s / speed);
+	} else {
+		setVelocity(0, -s);
+	}
 }
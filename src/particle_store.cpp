@@ -0,0 +1,156 @@
+// Contains member functions of the ParticleStore class.
+// Stores the attributes of every particle in an environment as contiguous arrays, one array per attribute.
+#include <algorithm>
+#include "../include/particle_store.hpp"
+
+
+// Adds a particle after the awake particles and returns its index. Any sleeping particles are at the end of the arrays,
+// so the first of them is moved to the end to make room.
+int ParticleStore::add(float x, float y, float size, float mass, float vx, float vy, float elasticity, float drag) {
+	ids.add();
+	deferredVxs.push_back(0);
+	deferredVys.push_back(0);
+	drags.push_back(drag);
+	elasticities.push_back(elasticity);
+	masses.push_back(mass);
+	sizes.push_back(size);
+	vxs.push_back(vx);
+	vys.push_back(vy);
+	xs.push_back(x);
+	ys.push_back(y);
+	islands.push_back(0);
+	stillSteps.push_back(0);
+	collideWith.push_back(SlotId{-1, 0});
+	if (awake < xs.size() - 1) {
+		swap(awake, xs.size() - 1);
+	}
+	return awake++;
+}
+
+
+// Removes every particle.
+void ParticleStore::clear() {
+	ids.clear();
+	deferredVxs.clear();
+	deferredVys.clear();
+	drags.clear();
+	elasticities.clear();
+	masses.clear();
+	sizes.clear();
+	vxs.clear();
+	vys.clear();
+	xs.clear();
+	ys.clear();
+	islands.clear();
+	stillSteps.clear();
+	collideWith.clear();
+	awake = 0;
+}
+
+
+// Adds count particles with every attribute zero after the awake particles, and returns the index of the first, so that
+// they can be filled in place. Sleeping particles in the way are swapped to the end of the arrays.
+int ParticleStore::grow(int count) {
+	int first = xs.size();
+	for (int i = 0; i < count; i++) {
+		ids.add();
+	}
+	deferredVxs.resize(first + count);
+	deferredVys.resize(first + count);
+	drags.resize(first + count);
+	elasticities.resize(first + count);
+	masses.resize(first + count);
+	sizes.resize(first + count);
+	vxs.resize(first + count);
+	vys.resize(first + count);
+	xs.resize(first + count);
+	ys.resize(first + count);
+	islands.resize(first + count);
+	stillSteps.resize(first + count);
+	collideWith.resize(first + count, SlotId{-1, 0});
+	for (int k = 0; k < std::min(first - awake, count); k++) {
+		swap(awake + k, first + count - 1 - k);
+	}
+	awake += count;
+	return awake - count;
+}
+
+
+// Removes the particle at the index by moving the last particle into its place. When there are sleeping particles, an
+// awake particle is first swapped with the last awake particle, so that the last particle stays among the sleeping ones.
+void ParticleStore::remove(int index) {
+	if (index < awake) {
+		awake--;
+		if (awake < xs.size() - 1 && index != awake) {
+			swap(index, awake);
+			index = awake;
+		}
+	}
+	ids.remove(ids.getSlot(index));
+	moveLast(deferredVxs, index);
+	moveLast(deferredVys, index);
+	moveLast(drags, index);
+	moveLast(elasticities, index);
+	moveLast(masses, index);
+	moveLast(sizes, index);
+	moveLast(vxs, index);
+	moveLast(vys, index);
+	moveLast(xs, index);
+	moveLast(ys, index);
+	moveLast(islands, index);
+	moveLast(stillSteps, index);
+	moveLast(collideWith, index);
+}
+
+
+// Reserves space for a number of particles, so that adding them does not reallocate the arrays.
+void ParticleStore::reserve(int count) {
+	ids.reserve(count);
+	deferredVxs.reserve(count);
+	deferredVys.reserve(count);
+	drags.reserve(count);
+	elasticities.reserve(count);
+	masses.reserve(count);
+	sizes.reserve(count);
+	vxs.reserve(count);
+	vys.reserve(count);
+	xs.reserve(count);
+	ys.reserve(count);
+	islands.reserve(count);
+	stillSteps.reserve(count);
+	collideWith.reserve(count);
+}
+
+
+// Puts the awake particle at the index to sleep, by swapping it with the last awake particle, and returns its new index.
+int ParticleStore::sleep(int index) {
+	awake--;
+	swap(index, awake);
+	return awake;
+}
+
+
+// Swaps the particles at two indices.
+void ParticleStore::swap(int a, int b) {
+	ids.swap(a, b);
+	std::swap(deferredVxs[a], deferredVxs[b]);
+	std::swap(deferredVys[a], deferredVys[b]);
+	std::swap(drags[a], drags[b]);
+	std::swap(elasticities[a], elasticities[b]);
+	std::swap(masses[a], masses[b]);
+	std::swap(sizes[a], sizes[b]);
+	std::swap(vxs[a], vxs[b]);
+	std::swap(vys[a], vys[b]);
+	std::swap(xs[a], xs[b]);
+	std::swap(ys[a], ys[b]);
+	std::swap(islands[a], islands[b]);
+	std::swap(stillSteps[a], stillSteps[b]);
+	std::swap(collideWith[a], collideWith[b]);
+}
+
+
+// Wakes the sleeping particle at the index, by swapping it with the first sleeping particle, and returns its new index.
+int ParticleStore::wake(int index) {
+	swap(index, awake);
+	return awake++;
+}
@@ -0,0 +1,156 @@
+// Contains member functions of the QuadTree class.
+// Groups particles into a Barnes-Hut quadtree so that distant groups of particles attract as a single mass.
+#include <algorithm>
+#include "../include/particle.hpp"
+#include "../include/quadtree.hpp"
+#include "../include/tracer.hpp"
+
+// Nodes are not split below this depth, so particles at the same position share a leaf instead of recursing forever.
+static const int MAX_DEPTH = 32;
+
+
+// Adds an empty leaf node to the tree and returns its index.
+int QuadTree::addNode(float centreX, float centreY, float half) {
+	Node node;
+	node.centreX = centreX;
+	node.centreY = centreY;
+	node.half = half;
+	nodes.push_back(node);
+	return nodes.size() - 1;
+}
+
+
+// Rebuilds the tree around the particles, with a root node covering the region (minX, minY) to (maxX, maxY).
+void QuadTree::build(ParticleStore const& particles, float minX, float minY, float maxX, float maxY) {
+	CPPARTICLES_TRACE_SCOPE("build quadtree");
+	int count = particles.xs.size();
+	xs.resize(count);
+	ys.resize(count);
+	masses.resize(count);
+	next.assign(count, -1);
+	for (int i = 0; i < count; i++) {
+		xs[i] = particles.xs[i];
+		ys[i] = particles.ys[i];
+		masses[i] = particles.masses[i];
+		minX = std::min(minX, xs[i]);
+		minY = std::min(minY, ys[i]);
+		maxX = std::max(maxX, xs[i]);
+		maxY = std::max(maxY, ys[i]);
+	}
+	nodes.clear();
+	addNode(0.5 * (minX + maxX), 0.5 * (minY + maxY), 0.5 * std::max(maxX - minX, maxY - minY) + 1);
+	for (int i = 0; i < count; i++) {
+		insert(i);
+	}
+	sumMass(0);
+}
+
+
+// Sums the acceleration (ax, ay) of a particle towards every other particle, treating each node as a single mass
+// when its width is less than theta times its distance. A theta of 0 compares every pair of particles.
+void QuadTree::getAcceleration(int index, float theta, float softening, float &ax, float &ay) const {
+	float x = xs[index];
+	float y = ys[index];
+	ax = 0;
+	ay = 0;
+	// Each level of the tree leaves at most three siblings waiting on the stack, so it cannot overflow. Keeping the
+	// stack local lets several threads walk the tree at once.
+	int stack[4 * MAX_DEPTH + 4];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		Node const& node = nodes[stack[--top]];
+		if (node.children == -1) {
+			for (int j = node.first; j != -1; j = next[j]) {
+				float dx = xs[j] - x;
+				float dy = ys[j] - y;
+				float distance2 = dx * dx + dy * dy;
+				if (j == index || distance2 == 0) {
+					continue;
+				}
+				float soft2 = distance2 + softening * softening;
+				float a = GRAVITATIONAL_CONSTANT * masses[j] / (soft2 * sqrt(soft2));
+				ax += a * dx;
+				ay += a * dy;
+			}
+			continue;
+		}
+		if (node.mass == 0) {
+			continue;
+		}
+		float dx = node.massX / node.mass - x;
+		float dy = node.massY / node.mass - y;
+		float distance2 = dx * dx + dy * dy;
+		bool inside = fabs(x - node.centreX) <= node.half && fabs(y - node.centreY) <= node.half;
+		if (!inside && 4 * node.half * node.half < theta * theta * distance2) {
+			float soft2 = distance2 + softening * softening;
+			float a = GRAVITATIONAL_CONSTANT * node.mass / (soft2 * sqrt(soft2));
+			ax += a * dx;
+			ay += a * dy;
+		} else {
+			for (int c = 0; c < 4; c++) {
+				stack[top++] = node.children + c;
+			}
+		}
+	}
+}
+
+
+// Inserts a particle into the leaf containing it, splitting the leaf if it is already occupied.
+void QuadTree::insert(int index) {
+	int node = 0;
+	for (int depth = 0; ; depth++) {
+		if (nodes[node].children == -1) {
+			if (nodes[node].first == -1 || depth == MAX_DEPTH) {
+				next[index] = nodes[node].first;
+				nodes[node].first = index;
+				return;
+			}
+			// Split the leaf and push its particles down into the new children.
+			float half = 0.5 * nodes[node].half;
+			float centreX = nodes[node].centreX;
+			float centreY = nodes[node].centreY;
+			int children = addNode(centreX - half, centreY - half, half);
+			addNode(centreX + half, centreY - half, half);
+			addNode(centreX - half, centreY + half, half);
+			addNode(centreX + half, centreY + half, half);
+			int moved = nodes[node].first;
+			nodes[node].children = children;
+			nodes[node].first = -1;
+			while (moved != -1) {
+				int following = next[moved];
+				int child = children + (xs[moved] >= centreX) + 2 * (ys[moved] >= centreY);
+				next[moved] = nodes[child].first;
+				nodes[child].first = moved;
+				moved = following;
+			}
+		}
+		node = nodes[node].children + (xs[index] >= nodes[node].centreX) + 2 * (ys[index] >= nodes[node].centreY);
+	}
+}
+
+
+// Sums the mass and mass-weighted position of every node below and including the given node.
+void QuadTree::sumMass(int node) {
+	float mass = 0;
+	float massX = 0;
+	float massY = 0;
+	if (nodes[node].children == -1) {
+		for (int j = nodes[node].first; j != -1; j = next[j]) {
+			mass += masses[j];
+			massX += masses[j] * xs[j];
+			massY += masses[j] * ys[j];
+		}
+	} else {
+		for (int c = 0; c < 4; c++) {
+			int child = nodes[node].children + c;
+			sumMass(child);
+			mass += nodes[child].mass;
+			massX += nodes[child].massX;
+			massY += nodes[child].massY;
+		}
+	}
+	nodes[node].mass = mass;
+	nodes[node].massX = massX;
+	nodes[node].massY = massY;
+}
@@ -0,0 +1,75 @@
+// Contains the function that extracts the visible particles and springs of a snapshot for drawing.
+#include <algorithm>
+#include "../include/render.hpp"
+#include "../include/tracer.hpp"
+
+
+// Fills the batch with the particles and springs of the snapshot that are visible in the view, in one pass over each.
+// The view's size must already be given, as the snapshot does not know the size of its environment.
+void extractRender(Snapshot const& snapshot, RenderView const& view, RenderBatch &batch) {
+	CPPARTICLES_TRACE_SCOPE("extract render");
+	int count = snapshot.xs.size();
+	float zoom = view.zoom;
+	float offsetX = -view.left * zoom;
+	float offsetY = -view.top * zoom;
+	int stride = 3 + (view.velocities ? 2 : 0) + (view.masses ? 1 : 0);
+	batch.step = snapshot.step;
+	batch.stride = stride;
+
+	// The buffers are sized for every particle to be visible, and cut down to those that were afterwards.
+	batch.particles.resize((size_t)count * stride);
+	batch.indices.resize(count);
+	float *instance = batch.particles.data();
+	int kept = 0;
+	for (int i = 0; i < count; i++) {
+		float x = snapshot.xs[i] * zoom + offsetX;
+		float y = snapshot.ys[i] * zoom + offsetY;
+		float radius = snapshot.sizes[i] * zoom;
+		if (x + radius < 0 || x - radius > view.width || y + radius < 0 || y - radius > view.height) {
+			continue;
+		}
+		instance[0] = x;
+		instance[1] = y;
+		instance[2] = radius;
+		int k = 3;
+		if (view.velocities) {
+			instance[k++] = snapshot.vxs[i];
+			instance[k++] = snapshot.vys[i];
+		}
+		if (view.masses) {
+			instance[k] = snapshot.masses[i];
+		}
+		instance += stride;
+		batch.indices[kept++] = i;
+	}
+	batch.particleCount = kept;
+	batch.particles.resize((size_t)kept * stride);
+	batch.indices.resize(kept);
+
+	// A spring is kept if the box around its ends overlaps the target, which may keep a few that cross a corner
+	// without being seen.
+	int springCount = view.springs ? snapshot.p1s.size() : 0;
+	batch.springs.resize((size_t)springCount * 4);
+	float *segment = batch.springs.data();
+	kept = 0;
+	for (int k = 0; k < springCount; k++) {
+		int p1 = snapshot.p1s[k];
+		int p2 = snapshot.p2s[k];
+		float x1 = snapshot.xs[p1] * zoom + offsetX;
+		float y1 = snapshot.ys[p1] * zoom + offsetY;
+		float x2 = snapshot.xs[p2] * zoom + offsetX;
+		float y2 = snapshot.ys[p2] * zoom + offsetY;
+		if (std::max(x1, x2) < 0 || std::min(x1, x2) > view.width || std::max(y1, y2) < 0 ||
+			std::min(y1, y2) > view.height) {
+			continue;
+		}
+		segment[0] = x1;
+		segment[1] = y1;
+		segment[2] = x2;
+		segment[3] = y2;
+		segment += 4;
+		kept++;
+	}
+	batch.springCount = kept;
+	batch.springs.resize((size_t)kept * 4);
+}
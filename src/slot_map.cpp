@@ -0,0 +1,67 @@
+// Contains member functions of the SlotMap class.
+// Maps stable slots to the positions (indices) of elements in densely packed arrays.
+#include <utility>
+#include "../include/slot_map.hpp"
+
+
+// Adds an element to the end of the arrays and returns its slot.
+int SlotMap::add() {
+	int slot;
+	if (freeSlots.empty()) {
+		slot = indices.size();
+		indices.push_back(0);
+		generations.push_back(0);
+	} else {
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	indices[slot] = slots.size();
+	slots.push_back(slot);
+	return slot;
+}
+
+
+// Removes every element, freeing their slots.
+void SlotMap::clear() {
+	for (int i = 0; i < slots.size(); i++) {
+		indices[slots[i]] = -1;
+		generations[slots[i]]++;
+		freeSlots.push_back(slots[i]);
+	}
+	slots.clear();
+}
+
+
+// Returns whether the id refers to an element that has not been removed.
+bool SlotMap::isLive(SlotId id) const {
+	return id.slot >= 0 && id.slot < generations.size() && generations[id.slot] == id.generation && indices[id.slot] != -1;
+}
+
+
+// Removes the element in the slot and returns the index it occupied. The last element is moved to that index, so the
+// caller must move the last element of each of its arrays there and shrink them by one.
+int SlotMap::remove(int slot) {
+	int index = indices[slot];
+	int last = slots.size() - 1;
+	slots[index] = slots[last];
+	indices[slots[index]] = index;
+	slots.pop_back();
+	indices[slot] = -1;
+	generations[slot]++;
+	freeSlots.push_back(slot);
+	return index;
+}
+
+
+// Reserves space for a number of elements.
+void SlotMap::reserve(int count) {
+	slots.reserve(count);
+}
+
+
+// Swaps the elements at two indices. The caller must swap the elements of each of its arrays too.
+void SlotMap::swap(int a, int b) {
+	std::swap(slots[a], slots[b]);
+	indices[slots[a]] = a;
+	indices[slots[b]] = b;
+}
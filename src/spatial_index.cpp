@@ -0,0 +1,125 @@
+// Contains member functions of the SpatialIndex class.
+// Buckets particles into the cells of a grid by their slot, so that they can be found by position.
+#include <algorithm>
+#include "../include/spatial_index.hpp"
+
+
+// Rebuilds the index around the particles and the environment, sizing the cells to fit the largest particle.
+void SpatialIndex::build(ParticleStore const& particles, float width, float height) {
+	int count = particles.xs.size();
+	maxSize = 0;
+	minX = 0;
+	minY = 0;
+	maxX = width;
+	maxY = height;
+	for (int i = 0; i < count; i++) {
+		maxSize = std::max(maxSize, particles.sizes[i]);
+		minX = std::min(minX, particles.xs[i]);
+		minY = std::min(minY, particles.ys[i]);
+		maxX = std::max(maxX, particles.xs[i]);
+		maxY = std::max(maxY, particles.ys[i]);
+	}
+	cellSize = maxSize > 0 ? 2 * maxSize : 1;
+	long long maxCells = 4 * (long long)count + 64;
+	while (true) {
+		columns = static_cast<int>((maxX - minX) / cellSize) + 1;
+		rows = static_cast<int>((maxY - minY) / cellSize) + 1;
+		if (columns > 0 && rows > 0 && (long long)columns * rows <= maxCells) {
+			break;
+		}
+		cellSize *= 2;
+	}
+	builtCount = count;
+	heads.assign(columns * rows, -1);
+	cells.assign(cells.size(), -1);
+	for (int i = 0; i < count; i++) {
+		insert(particles.ids.getSlot(i), particles.xs[i], particles.ys[i], particles.sizes[i]);
+	}
+}
+
+
+// Returns the cell containing the coordinates (x, y). Coordinates outside the grid are clamped to the border cells,
+// so a box query always visits the cells of particles that have moved outside.
+int SpatialIndex::cellOf(float x, float y) const {
+	float cx = (x - minX) / cellSize;
+	float cy = (y - minY) / cellSize;
+	int column = cx > 0 ? (cx < columns - 1 ? static_cast<int>(cx) : columns - 1) : 0;
+	int row = cy > 0 ? (cy < rows - 1 ? static_cast<int>(cy) : rows - 1) : 0;
+	return row * columns + column;
+}
+
+
+// Adds a particle to the index.
+void SpatialIndex::insert(int slot, float x, float y, float size) {
+	if (slot >= cells.size()) {
+		cells.resize(slot + 1, -1);
+		next.resize(slot + 1, -1);
+		prev.resize(slot + 1, -1);
+	}
+	maxSize = std::max(maxSize, size);
+	link(slot, cellOf(x, y));
+}
+
+
+// Adds a particle to the front of a cell's list.
+void SpatialIndex::link(int slot, int cell) {
+	cells[slot] = cell;
+	prev[slot] = -1;
+	next[slot] = heads[cell];
+	if (heads[cell] != -1) {
+		prev[heads[cell]] = slot;
+	}
+	heads[cell] = slot;
+}
+
+
+// Moves every particle that has changed cell since the last refresh. The index is rebuilt instead if the particles
+// have outgrown the cells, spread far outside the grid, or doubled in number.
+void SpatialIndex::refresh(ParticleStore const& particles, float width, float height) {
+	int count = particles.xs.size();
+	int outside = 0;
+	float largest = 0;
+	for (int i = 0; i < count; i++) {
+		float x = particles.xs[i];
+		float y = particles.ys[i];
+		largest = std::max(largest, particles.sizes[i]);
+		if (x < minX || x > maxX || y < minY || y > maxY) {
+			outside++;
+		}
+	}
+	if (2 * largest > cellSize || 4 * outside > count || count > 2 * builtCount + 64) {
+		build(particles, width, height);
+		return;
+	}
+	maxSize = largest;
+	for (int i = 0; i < count; i++) {
+		int slot = particles.ids.getSlot(i);
+		int cell = cellOf(particles.xs[i], particles.ys[i]);
+		if (cell != cells[slot]) {
+			unlink(slot);
+			link(slot, cell);
+		}
+	}
+}
+
+
+// Removes a particle from the index.
+void SpatialIndex::remove(int slot) {
+	if (slot < cells.size() && cells[slot] != -1) {
+		unlink(slot);
+		cells[slot] = -1;
+	}
+}
+
+
+// Removes a particle from its cell's list.
+void SpatialIndex::unlink(int slot) {
+	if (prev[slot] != -1) {
+		next[prev[slot]] = next[slot];
+	} else {
+		heads[cells[slot]] = next[slot];
+	}
+	if (next[slot] != -1) {
+		prev[next[slot]] = prev[slot];
+	}
+}
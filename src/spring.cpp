@@ -3,19 +3,43 @@
 #include "../include/spring.hpp"
 
 
-// Spring constructor.
-Spring::Spring(Particle *p1, Particle *p2, float length, float strength):
-p1(p1), p2(p2), length(length), strength(strength) {
+// Spring constructor. Refers to the spring currently at the index of the store.
+Spring::Spring(SpringStore *store, int index):
+store(store), id(store->ids.getId(index)) {
+}
+
+
+// Spring constructor. Refers to the spring with the id in the store.
+Spring::Spring(SpringStore *store, SlotId id):
+store(store), id(id) {
+}
+
+
+// Returns the first particle connected by the spring.
+Particle Spring::getP1() {
+	return Particle(store->particles, store->particles->ids.getIndex(store->p1s[getIndex()]));
+}
+
+
+// Returns the second particle connected by the spring.
+Particle Spring::getP2() {
+	return Particle(store->particles, store->particles->ids.getIndex(store->p2s[getIndex()]));
 }
 
 
 // Updates the spring.
 void Spring::update() {
-	float dx = p1->getX() - p2->getX();
-	float dy = p1->getY() - p2->getY();
+	Particle p1 = getP1();
+	Particle p2 = getP2();
+	float length = getLength();
+	float strength = getStrength();
+	float dx = p1.getX() - p2.getX();
+	float dy = p1.getY() - p2.getY();
 	float distance = hypot(dx, dy);
-	float theta = atan2(dy, dx);
+	// Unit vector from p2 to p1. Particles at the same position are pushed apart along x.
+	float nx = distance > 0 ? dx / distance : 1;
+	float ny = distance > 0 ? dy / distance : 0;
 	float force = (length - distance) * strength;
-	p1->accelerate(Vector{static_cast<float>(theta + 0.5*M_PI), force / p1->getMass()});
-	p2->accelerate(Vector{static_cast<float>(theta - 0.5*M_PI), force / p2->getMass()});
+	p1.accelerate(nx * force / p1.getMass(), ny * force / p1.getMass());
+	p2.accelerate(-nx * force / p2.getMass(), -ny * force / p2.getMass());
 }
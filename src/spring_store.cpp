@@ -0,0 +1,152 @@
+// Contains member functions of the SpringStore class.
+// Stores the attributes of every spring in an environment as contiguous arrays, one array per attribute.
+#include <algorithm>
+#include "../include/spring_store.hpp"
+
+
+// SpringStore constructor. The springs connect particles in the given store.
+SpringStore::SpringStore(ParticleStore *particles):
+particles(particles) {
+}
+
+
+// Appends a spring between the particles in slots p1 and p2 to the end of the arrays and returns its index.
+int SpringStore::add(int p1, int p2, float length, float strength) {
+	ids.add();
+	lengths.push_back(length);
+	strengths.push_back(strength);
+	p1s.push_back(p1);
+	p2s.push_back(p2);
+	attachedCurrent = false;
+	colorsCurrent = false;
+	return p1s.size() - 1;
+}
+
+
+// Lists the springs attached to each particle slot, counting the springs at each slot before placing them.
+void SpringStore::attach() {
+	int count = p1s.size();
+	int slots = particles->ids.getSlotCount();
+	attachedOffsets.assign(slots + 1, 0);
+	for (int k = 0; k < count; k++) {
+		attachedOffsets[p1s[k] + 1]++;
+		attachedOffsets[p2s[k] + 1]++;
+	}
+	for (int slot = 0; slot < slots; slot++) {
+		attachedOffsets[slot + 1] += attachedOffsets[slot];
+	}
+	attachedSprings.resize(2 * count);
+	for (int k = 0; k < count; k++) {
+		attachedSprings[attachedOffsets[p1s[k]]++] = ids.getId(k);
+		attachedSprings[attachedOffsets[p2s[k]]++] = ids.getId(k);
+	}
+	for (int slot = slots; slot > 0; slot--) {
+		attachedOffsets[slot] = attachedOffsets[slot - 1];
+	}
+	attachedOffsets[0] = 0;
+	attachedCurrent = true;
+}
+
+
+// Removes every spring.
+void SpringStore::clear() {
+	ids.clear();
+	lengths.clear();
+	strengths.clear();
+	p1s.clear();
+	p2s.clear();
+	attachedOffsets.clear();
+	attachedSprings.clear();
+	attachedCurrent = false;
+	colorsCurrent = false;
+}
+
+
+// Groups the springs into colors, if they have changed since they were last grouped. Each color takes every spring
+// left that does not share a particle with a spring already in it, so there are rarely many more colors than there
+// are springs meeting at the busiest particle.
+void SpringStore::color() {
+	if (colorsCurrent) {
+		return;
+	}
+	int left = p1s.size();
+	colored.clear();
+	colorOffsets.assign(1, 0);
+	colorStamps.assign(particles->ids.getSlotCount(), -1);
+	uncolored.resize(left);
+	for (int k = 0; k < left; k++) {
+		uncolored[k] = k;
+	}
+	for (int color = 0; left > 0; color++) {
+		int kept = 0;
+		for (int n = 0; n < left; n++) {
+			int k = uncolored[n];
+			if (colorStamps[p1s[k]] != color && colorStamps[p2s[k]] != color) {
+				colorStamps[p1s[k]] = color;
+				colorStamps[p2s[k]] = color;
+				colored.push_back(k);
+			} else {
+				uncolored[kept++] = k;
+			}
+		}
+		left = kept;
+		colorOffsets.push_back(colored.size());
+	}
+	colorsCurrent = true;
+}
+
+
+// Adds count springs with every attribute zero to the end of the arrays, and returns the index of the first, so that
+// they can be filled in place.
+int SpringStore::grow(int count) {
+	int first = p1s.size();
+	for (int k = 0; k < count; k++) {
+		ids.add();
+	}
+	lengths.resize(first + count);
+	strengths.resize(first + count);
+	p1s.resize(first + count);
+	p2s.resize(first + count);
+	attachedCurrent = false;
+	colorsCurrent = false;
+	return first;
+}
+
+
+// Removes the spring at the index by moving the last spring into its place. The springs attached to each particle are
+// still listed by id, so removed springs are left in the lists to be skipped.
+void SpringStore::remove(int index) {
+	ids.remove(ids.getSlot(index));
+	moveLast(lengths, index);
+	moveLast(strengths, index);
+	moveLast(p1s, index);
+	moveLast(p2s, index);
+	colorsCurrent = false;
+}
+
+
+// Removes every spring attached to the particle in the slot.
+void SpringStore::removeAttached(int particle) {
+	if (!attachedCurrent) {
+		attach();
+	}
+	if (particle >= attachedOffsets.size() - 1) {
+		return;
+	}
+	for (int k = attachedOffsets[particle]; k < attachedOffsets[particle + 1]; k++) {
+		SlotId id = attachedSprings[k];
+		if (ids.isLive(id)) {
+			remove(ids.getIndex(id.slot));
+		}
+	}
+}
+
+
+// Reserves space for a number of springs, so that adding them does not reallocate the arrays.
+void SpringStore::reserve(int count) {
+	ids.reserve(count);
+	lengths.reserve(count);
+	strengths.reserve(count);
+	p1s.reserve(count);
+	p2s.reserve(count);
+}
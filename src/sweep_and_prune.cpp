@@ -0,0 +1,114 @@
+// Contains member functions of the SweepAndPrune class.
+// Finds the pairs of particles whose bounding boxes overlap, by sweeping the boxes in order of their left edges.
+#include <algorithm>
+#include "../include/sweep_and_prune.hpp"
+#include "../include/tracer.hpp"
+
+
+// Brings the boxes up to date with the particles, sorts them again and finds the neighbours of the awake particles.
+// Boxes are kept by slot, so the order found in the last update is kept when particles are removed or reordered.
+void SweepAndPrune::update(ParticleStore const& particles, int awake) {
+	CPPARTICLES_TRACE_SCOPE("sweep and prune");
+	int count = particles.xs.size();
+	int kept = 0;
+	for (int k = 0; k < boxes.size(); k++) {
+		SlotId id = boxes[k].id;
+		if (!particles.ids.isLive(id)) {
+			continue;
+		}
+		int i = particles.ids.getIndex(id.slot);
+		float x = particles.xs[i];
+		float y = particles.ys[i];
+		float size = particles.sizes[i];
+		boxes[kept++] = Box{x - size, x + size, y - size, y + size, i, id};
+	}
+	boxes.resize(kept);
+
+	// Particles added since the last update go at the end, to be sorted into place.
+	int added = count - kept;
+	if (added > 0) {
+		listed.assign(particles.ids.getSlotCount(), false);
+		for (int k = 0; k < kept; k++) {
+			listed[boxes[k].id.slot] = true;
+		}
+		for (int i = 0; i < count; i++) {
+			if (!listed[particles.ids.getSlot(i)]) {
+				float x = particles.xs[i];
+				float y = particles.ys[i];
+				float size = particles.sizes[i];
+				boxes.push_back(Box{x - size, x + size, y - size, y + size, i, particles.ids.getId(i)});
+			}
+		}
+	}
+	sort(added);
+	sweep(awake);
+}
+
+
+// Sorts the boxes by their left edges. Insertion sort takes time in proportion to how far the boxes have moved past
+// each other, so it is used unless many particles have been added, or the boxes turn out to have been shuffled, when
+// they are sorted from scratch instead.
+void SweepAndPrune::sort(int added) {
+	int count = boxes.size();
+	auto byLeft = [](Box const& a, Box const& b) { return a.left < b.left; };
+	if (added > count / 8 + 16) {
+		std::sort(boxes.begin(), boxes.end(), byLeft);
+		return;
+	}
+	long moves = 0;
+	long budget = 8 * (long)count + 64;
+	for (int k = 1; k < count; k++) {
+		Box box = boxes[k];
+		int j = k;
+		while (j > 0 && boxes[j - 1].left > box.left) {
+			boxes[j] = boxes[j - 1];
+			j--;
+		}
+		boxes[j] = box;
+		moves += k - j;
+		if (moves > budget) {
+			std::sort(boxes.begin(), boxes.end(), byLeft);
+			return;
+		}
+	}
+}
+
+
+// Finds every pair of overlapping boxes with an awake particle, and lists each pair under the lower index of the two.
+// Each box only needs to be compared with the boxes after it whose left edges it reaches.
+void SweepAndPrune::sweep(int awake) {
+	int count = boxes.size();
+	pairs.clear();
+	for (int r = 0; r < count; r++) {
+		Box const& a = boxes[r];
+		for (int k = r + 1; k < count && boxes[k].left <= a.right; k++) {
+			Box const& b = boxes[k];
+			if (b.top <= a.bottom && b.bottom >= a.top) {
+				int low = std::min(a.index, b.index);
+				if (low < awake) {
+					pairs.push_back(std::make_pair(low, std::max(a.index, b.index)));
+				}
+			}
+		}
+	}
+
+	// Each particle's neighbours are sorted, so that they are visited in the same order as by the brute force loop.
+	offsets.assign(awake + 1, 0);
+	for (int k = 0; k < pairs.size(); k++) {
+		offsets[pairs[k].first + 1]++;
+	}
+	for (int i = 0; i < awake; i++) {
+		offsets[i + 1] += offsets[i];
+	}
+	neighbours.resize(pairs.size());
+	for (int k = 0; k < pairs.size(); k++) {
+		neighbours[offsets[pairs[k].first]++] = pairs[k].second;
+	}
+	for (int i = awake; i > 0; i--) {
+		offsets[i] = offsets[i - 1];
+	}
+	offsets[0] = 0;
+	for (int i = 0; i < awake; i++) {
+		std::sort(neighbours.begin() + offsets[i], neighbours.begin() + offsets[i + 1]);
+	}
+}
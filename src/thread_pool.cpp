@@ -0,0 +1,86 @@
+// Contains member functions of the ThreadPool class.
+// Runs numbered tasks on a fixed set of worker threads, balancing the load by work stealing.
+#include "../include/thread_pool.hpp"
+#include "../include/tracer.hpp"
+
+
+// ThreadPool constructor. The thread calling run() acts as worker 0, so count - 1 threads are started.
+ThreadPool::ThreadPool(int count):
+count(count), queues(new Queue[count]) {
+	for (int i = 0; i < count; i++) {
+		queues[i].next = 0;
+		queues[i].end = 0;
+	}
+	for (int i = 1; i < count; i++) {
+		threads.push_back(std::thread(&ThreadPool::work, this, i));
+	}
+}
+
+
+// ThreadPool destructor. Stops and joins every worker thread.
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	started.notify_all();
+	for (int i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+}
+
+
+// Calls function(task, worker) once for every task from 0 to tasks - 1, and returns when all of them are finished.
+// Tasks may run in any order and on any worker.
+void ThreadPool::run(int tasks, std::function<void(int task, int worker)> const& function) {
+	for (int i = 0; i < count; i++) {
+		queues[i].next = static_cast<long long>(tasks) * i / count;
+		queues[i].end = static_cast<long long>(tasks) * (i + 1) / count;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->function = &function;
+		busy = count - 1;
+		generation++;
+	}
+	started.notify_all();
+	runTasks(0);
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this] { return busy == 0; });
+	this->function = nullptr;
+}
+
+
+// Runs the tasks in the worker's own share, then steals the remaining tasks of the other workers.
+void ThreadPool::runTasks(int worker) {
+	CPPARTICLES_TRACE_SCOPE("tasks");
+	for (int i = 0; i < count; i++) {
+		Queue &queue = queues[(worker + i) % count];
+		for (int task = queue.next++; task < queue.end; task = queue.next++) {
+			(*function)(task, worker);
+		}
+	}
+}
+
+
+// Waits for each call to run() and helps to finish its tasks, until the pool is destroyed.
+void ThreadPool::work(int worker) {
+	CPPARTICLES_TRACE_THREAD("worker " + std::to_string(worker));
+	int seen = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			started.wait(lock, [this, seen] { return stopping || generation != seen; });
+			if (stopping) {
+				return;
+			}
+			seen = generation;
+		}
+		runTasks(worker);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busy--;
+		}
+		finished.notify_one();
+	}
+}
@@ -0,0 +1,112 @@
+// Contains member functions of the Tracer class.
+// Records timed spans from every thread into per-thread ring buffers and writes them out as Chrome trace events.
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include "../include/tracer.hpp"
+
+std::atomic<bool> Tracer::enabled(false);
+// The ring buffers of every thread that has recorded a span. Rings outlive their threads, so that their spans can
+// still be written after the threads have finished.
+std::mutex Tracer::ringsMutex;
+std::vector<std::unique_ptr<Tracer::Ring> > Tracer::rings;
+int Tracer::ringCapacity = 1 << 16;
+thread_local Tracer::Ring *Tracer::threadRing = nullptr;
+thread_local std::string Tracer::threadName;
+static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+
+// Discards every recorded span.
+void Tracer::clear() {
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	for (int i = 0; i < rings.size(); i++) {
+		rings[i]->count.store(0, std::memory_order_relaxed);
+	}
+}
+
+
+// Returns the calling thread's ring buffer, creating it on the thread's first span.
+Tracer::Ring * Tracer::getRing() {
+	if (!threadRing) {
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		Ring *ring = new Ring();
+		ring->spans.reset(new Span[ringCapacity]);
+		ring->capacity = ringCapacity;
+		ring->thread = rings.size();
+		ring->name = threadName.empty() ? "thread " + std::to_string(ring->thread) : threadName;
+		ring->count.store(0, std::memory_order_relaxed);
+		rings.push_back(std::unique_ptr<Ring>(ring));
+		threadRing = ring;
+	}
+	return threadRing;
+}
+
+
+// Returns the time since the tracer started, in nanoseconds.
+long long Tracer::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+
+// Records a span on the calling thread, from start to end in nanoseconds.
+void Tracer::record(const char *name, long long start, long long end) {
+	Ring *ring = getRing();
+	long long count = ring->count.load(std::memory_order_relaxed);
+	ring->spans[count % ring->capacity] = Span{name, start, end};
+	ring->count.store(count + 1, std::memory_order_release);
+}
+
+
+// Sets the number of spans kept for each thread that has not yet recorded one.
+void Tracer::setCapacity(int spans) {
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	ringCapacity = spans > 0 ? spans : 1;
+}
+
+
+// Names the calling thread in the written trace. The name is kept until the thread records its first span, so
+// threads that never record one cost nothing.
+void Tracer::setThreadName(std::string const& name) {
+	threadName = name;
+	if (threadRing) {
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		threadRing->name = name;
+	}
+}
+
+
+// Writes the recorded spans to a file, returning whether it was written.
+bool Tracer::write(const char *path) {
+	std::ofstream out(path);
+	if (!out) {
+		return false;
+	}
+	write(out);
+	return static_cast<bool>(out);
+}
+
+
+// Writes the recorded spans as a Chrome trace event JSON object. Threads must not be recording spans while it is
+// written, or the spans being overwritten may be written torn.
+void Tracer::write(std::ostream &out) {
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+	bool first = true;
+	char buffer[64];
+	for (int i = 0; i < rings.size(); i++) {
+		Ring &ring = *rings[i];
+		out << (first ? "" : ",") << "\n{\"ph\": \"M\", \"pid\": 1, \"tid\": " << ring.thread
+			<< ", \"name\": \"thread_name\", \"args\": {\"name\": \"" << ring.name << "\"}}";
+		first = false;
+		long long count = ring.count.load(std::memory_order_acquire);
+		long long oldest = count > ring.capacity ? count - ring.capacity : 0;
+		for (long long k = oldest; k < count; k++) {
+			Span &span = ring.spans[k % ring.capacity];
+			// Timestamps are in microseconds, kept to the nanosecond.
+			snprintf(buffer, sizeof(buffer), "%.3f, \"dur\": %.3f", span.start / 1000.0, (span.end - span.start) / 1000.0);
+			out << ",\n{\"ph\": \"X\", \"pid\": 1, \"tid\": " << ring.thread << ", \"name\": \"" << span.name
+				<< "\", \"ts\": " << buffer << "}";
+		}
+	}
+	out << "\n]}\n";
+}
@@ -0,0 +1,347 @@
+// Contains member functions of the TrajectoryRecorder and TrajectoryReader classes.
+// Records the particles' positions and sizes after every update as quantized differences, and plays them back.
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "../include/trajectory.hpp"
+#include "../include/tracer.hpp"
+
+// Start of a trajectory file.
+struct TrajectoryHeader {
+	char magic[8];				// "CPPTRAJ" and a terminating zero.
+	uint32_t version;
+	uint32_t byteOrder;			// 0x01020304 as written by the recording machine.
+	float quantum;
+	uint32_t keyframeInterval;
+};
+
+// Start of each chunk of frames, followed by size bytes of encoded frames.
+struct ChunkHeader {
+	char magic[4];				// "CHNK".
+	uint32_t frames;
+	int64_t firstFrame;
+	uint32_t size;
+	uint32_t reserved;
+};
+
+// Largest slot a reader accepts, so that a corrupt file cannot make it allocate without limit.
+static const int32_t MAX_SLOT = 1 << 28;
+
+
+// Appends a signed value as a zigzag encoded variable-length integer: seven bits a byte, smallest magnitudes first.
+static void putVarint(std::vector<unsigned char> &out, int64_t value) {
+	uint64_t bits = (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+	while (bits >= 0x80) {
+		out.push_back(static_cast<unsigned char>(bits | 0x80));
+		bits >>= 7;
+	}
+	out.push_back(static_cast<unsigned char>(bits));
+}
+
+
+// Reads a value written by putVarint, returning false if it runs past the end of the data.
+static bool getVarint(std::vector<unsigned char> const& in, std::size_t &position, int64_t &value) {
+	uint64_t bits = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (position >= in.size()) {
+			return false;
+		}
+		unsigned char byte = in[position++];
+		bits |= static_cast<uint64_t>(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			value = static_cast<int64_t>(bits >> 1) ^ -static_cast<int64_t>(bits & 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// Rounds a coordinate to a whole number of quanta, clamped so that distant or invalid values cannot overflow.
+static int32_t quantize(float value, float quantum) {
+	float q = value / quantum;
+	if (!(q > -1e9f)) return -1000000000;
+	if (q > 1e9f) return 1000000000;
+	return static_cast<int32_t>(std::lround(q));
+}
+
+
+// TrajectoryRecorder destructor. Writes any frames still buffered.
+TrajectoryRecorder::~TrajectoryRecorder() {
+	close();
+}
+
+
+// Writes the frames still buffered and closes the file, returning whether every frame was written.
+bool TrajectoryRecorder::close() {
+	if (!file) {
+		return false;
+	}
+	if (chunkFrames > 0) {
+		startChunk();
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	queued.notify_all();
+	writer.join();
+	if (fclose(file) != 0) {
+		failed = true;
+	}
+	file = nullptr;
+	return !failed;
+}
+
+
+// Opens a file to record to, returning whether it was opened. Positions and sizes are rounded to multiples of the
+// quantum, and a keyframe is stored every keyframeInterval frames.
+bool TrajectoryRecorder::open(const char *path, float quantum, int keyframeInterval) {
+	close();
+	file = fopen(path, "wb");
+	if (!file) {
+		return false;
+	}
+	this->quantum = quantum;
+	this->keyframeInterval = std::max(keyframeInterval, 1);
+	frameCount = 0;
+	chunkFrames = 0;
+	stopping = false;
+	failed = false;
+	TrajectoryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "CPPTRAJ", 8);
+	header.version = TRAJECTORY_VERSION;
+	header.byteOrder = 0x01020304;
+	header.quantum = quantum;
+	header.keyframeInterval = this->keyframeInterval;
+	if (fwrite(&header, sizeof(header), 1, file) != 1) {
+		failed = true;
+	}
+	writer = std::thread(&TrajectoryRecorder::write, this);
+	startChunk();
+	return true;
+}
+
+
+// Encodes the particles as the next frame. Each particle is written as the differences of its slot from the previous
+// particle's, and of its generation, position and size from its own in the previous frame of the chunk.
+void TrajectoryRecorder::record(long step, ParticleStore &particles) {
+	if (!file) {
+		return;
+	}
+	CPPARTICLES_TRACE_SCOPE("record");
+	int count = particles.getCount();
+	putVarint(chunk, step);
+	putVarint(chunk, count);
+	int32_t previous = 0;
+	for (int i = 0; i < count; i++) {
+		int32_t slot = particles.ids.getSlot(i);
+		if (slot >= lastXs.size()) {
+			lastGenerations.resize(slot + 1, 0);
+			lastXs.resize(slot + 1, 0);
+			lastYs.resize(slot + 1, 0);
+			lastSizes.resize(slot + 1, 0);
+		}
+		int32_t generation = particles.ids.getGeneration(slot);
+		int32_t x = quantize(particles.xs[i], quantum);
+		int32_t y = quantize(particles.ys[i], quantum);
+		int32_t size = quantize(particles.sizes[i], quantum);
+		putVarint(chunk, (int64_t)slot - previous);
+		putVarint(chunk, (int64_t)generation - lastGenerations[slot]);
+		putVarint(chunk, (int64_t)x - lastXs[slot]);
+		putVarint(chunk, (int64_t)y - lastYs[slot]);
+		putVarint(chunk, (int64_t)size - lastSizes[slot]);
+		previous = slot;
+		lastGenerations[slot] = generation;
+		lastXs[slot] = x;
+		lastYs[slot] = y;
+		lastSizes[slot] = size;
+	}
+	frameCount++;
+	chunkFrames++;
+	if (chunkFrames == keyframeInterval) {
+		startChunk();
+	}
+}
+
+
+// Hands the current chunk, if it holds any frames, to the writer thread, and starts a new chunk with a keyframe.
+void TrajectoryRecorder::startChunk() {
+	if (chunkFrames > 0) {
+		ChunkHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, "CHNK", 4);
+		header.frames = chunkFrames;
+		header.firstFrame = chunkFirstFrame;
+		header.size = chunk.size() - sizeof(header);
+		memcpy(chunk.data(), &header, sizeof(header));
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(std::move(chunk));
+		}
+		queued.notify_one();
+	}
+	chunk.clear();
+	chunk.resize(sizeof(ChunkHeader));
+	chunkFrames = 0;
+	chunkFirstFrame = frameCount;
+	std::fill(lastGenerations.begin(), lastGenerations.end(), 0);
+	std::fill(lastXs.begin(), lastXs.end(), 0);
+	std::fill(lastYs.begin(), lastYs.end(), 0);
+	std::fill(lastSizes.begin(), lastSizes.end(), 0);
+}
+
+
+// Writes the queued chunks to the file on the writer thread, until the recorder is closed.
+void TrajectoryRecorder::write() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		queued.wait(lock, [this] { return stopping || !queue.empty(); });
+		if (queue.empty()) {
+			return;
+		}
+		std::vector<unsigned char> next = std::move(queue.front());
+		queue.pop_front();
+		lock.unlock();
+		if (fwrite(next.data(), 1, next.size(), file) != next.size()) {
+			failed = true;
+		}
+		lock.lock();
+	}
+}
+
+
+// TrajectoryReader destructor.
+TrajectoryReader::~TrajectoryReader() {
+	close();
+}
+
+
+// Closes the file.
+void TrajectoryReader::close() {
+	if (file) {
+		fclose(file);
+	}
+	file = nullptr;
+	chunks.clear();
+	frameCount = 0;
+	loadedChunk = -1;
+	nextFrame = -1;
+}
+
+
+// Decodes the next frame of the loaded chunk into the snapshot, returning false if the chunk is corrupt.
+bool TrajectoryReader::decodeFrame(Snapshot &snapshot) {
+	int64_t step, count;
+	if (!getVarint(chunk, position, step) || !getVarint(chunk, position, count) || count < 0 || count > MAX_SLOT) {
+		return false;
+	}
+	snapshot.step = step;
+	snapshot.ids.resize(count);
+	snapshot.xs.resize(count);
+	snapshot.ys.resize(count);
+	snapshot.sizes.resize(count);
+	int64_t slot = 0;
+	for (int i = 0; i < count; i++) {
+		int64_t dSlot, dGeneration, dx, dy, dSize;
+		if (!getVarint(chunk, position, dSlot) || !getVarint(chunk, position, dGeneration) || !getVarint(chunk, position, dx)
+			|| !getVarint(chunk, position, dy) || !getVarint(chunk, position, dSize)) {
+			return false;
+		}
+		slot += dSlot;
+		if (slot < 0 || slot >= MAX_SLOT) {
+			return false;
+		}
+		if (slot >= lastXs.size()) {
+			lastGenerations.resize(slot + 1, 0);
+			lastXs.resize(slot + 1, 0);
+			lastYs.resize(slot + 1, 0);
+			lastSizes.resize(slot + 1, 0);
+		}
+		lastGenerations[slot] += dGeneration;
+		lastXs[slot] += dx;
+		lastYs[slot] += dy;
+		lastSizes[slot] += dSize;
+		snapshot.ids[i] = SlotId{static_cast<int>(slot), lastGenerations[slot]};
+		snapshot.xs[i] = lastXs[slot] * quantum;
+		snapshot.ys[i] = lastYs[slot] * quantum;
+		snapshot.sizes[i] = lastSizes[slot] * quantum;
+	}
+	return true;
+}
+
+
+// Opens a recorded file, returning whether it is a trajectory of this version. The chunks are found by skipping from
+// one chunk header to the next, so a file whose recording was cut short can still be read up to its last whole chunk.
+bool TrajectoryReader::open(const char *path) {
+	close();
+	file = fopen(path, "rb");
+	if (!file) {
+		return false;
+	}
+	TrajectoryHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, "CPPTRAJ", 8) != 0
+		|| header.version != TRAJECTORY_VERSION || header.byteOrder != 0x01020304 || !(header.quantum > 0)) {
+		close();
+		return false;
+	}
+	quantum = header.quantum;
+	long offset = sizeof(header);
+	fseek(file, 0, SEEK_END);
+	long end = ftell(file);
+	while (offset + (long)sizeof(ChunkHeader) <= end) {
+		ChunkHeader chunkHeader;
+		fseek(file, offset, SEEK_SET);
+		if (fread(&chunkHeader, sizeof(chunkHeader), 1, file) != 1 || memcmp(chunkHeader.magic, "CHNK", 4) != 0
+			|| chunkHeader.firstFrame != frameCount || offset + (long)sizeof(chunkHeader) + (long)chunkHeader.size > end) {
+			break;
+		}
+		chunks.push_back(Chunk{frameCount, static_cast<int>(chunkHeader.frames), offset + (long)sizeof(chunkHeader), chunkHeader.size});
+		frameCount += chunkHeader.frames;
+		offset += sizeof(chunkHeader) + chunkHeader.size;
+	}
+	return true;
+}
+
+
+// Reads a frame into the snapshot's ids, positions and sizes, and its step, returning whether it could be read. The
+// snapshot's other arrays are emptied, as they are not recorded.
+bool TrajectoryReader::readFrame(long frame, Snapshot &snapshot) {
+	if (!file || frame < 0 || frame >= frameCount) {
+		return false;
+	}
+	int index = std::upper_bound(chunks.begin(), chunks.end(), frame, [](long f, Chunk const& c) { return f < c.firstFrame; }) - chunks.begin() - 1;
+	// Start again from the chunk's keyframe, unless the frame is further on in the chunk being read.
+	if (index != loadedChunk || frame < nextFrame) {
+		Chunk &c = chunks[index];
+		chunk.resize(c.size);
+		fseek(file, c.offset, SEEK_SET);
+		if (fread(chunk.data(), 1, c.size, file) != c.size) {
+			loadedChunk = -1;
+			return false;
+		}
+		loadedChunk = index;
+		nextFrame = c.firstFrame;
+		position = 0;
+		std::fill(lastGenerations.begin(), lastGenerations.end(), 0);
+		std::fill(lastXs.begin(), lastXs.end(), 0);
+		std::fill(lastYs.begin(), lastYs.end(), 0);
+		std::fill(lastSizes.begin(), lastSizes.end(), 0);
+	}
+	snapshot.vxs.clear();
+	snapshot.vys.clear();
+	snapshot.masses.clear();
+	snapshot.p1s.clear();
+	snapshot.p2s.clear();
+	snapshot.lengths.clear();
+	snapshot.strengths.clear();
+	while (nextFrame <= frame) {
+		if (!decodeFrame(snapshot)) {
+			loadedChunk = -1;
+			return false;
+		}
+		nextFrame++;
+	}
+	return true;
+}
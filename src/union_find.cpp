@@ -0,0 +1,40 @@
+// Contains member functions of the UnionFind class.
+// Partitions the numbers from 0 to count - 1 into disjoint groups, which can be joined together.
+#include <utility>
+#include "../include/union_find.hpp"
+
+
+// Returns the representative element of the group containing the element.
+int UnionFind::find(int element) {
+	// Path halving: point every other element on the path at its grandparent.
+	while (parents[element] != element) {
+		parents[element] = parents[parents[element]];
+		element = parents[element];
+	}
+	return element;
+}
+
+
+// Puts every element into a group of its own.
+void UnionFind::reset(int count) {
+	parents.resize(count);
+	sizes.assign(count, 1);
+	for (int i = 0; i < count; i++) {
+		parents[i] = i;
+	}
+}
+
+
+// Joins the groups containing elements a and b, attaching the smaller group to the larger.
+void UnionFind::unite(int a, int b) {
+	a = find(a);
+	b = find(b);
+	if (a == b) {
+		return;
+	}
+	if (sizes[a] < sizes[b]) {
+		std::swap(a, b);
+	}
+	parents[b] = a;
+	sizes[a] += sizes[b];
+}
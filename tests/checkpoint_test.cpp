@@ -0,0 +1,65 @@
+// Checks that an environment loaded from a checkpoint carries on exactly as the saved environment does.
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "../include/cpparticles.hpp"
+
+static const char *integrators[] = {"explicit euler", "semi-implicit euler", "velocity verlet"};
+
+
+// Runs an environment for a number of updates and returns the position, velocity and size of every particle.
+static std::vector<float> run(Environment &env, int updates) {
+	for (int step = 0; step < updates; step++) {
+		env.update();
+	}
+	std::vector<float> state;
+	for (Particle particle : env.getParticles()) {
+		state.push_back(particle.getX());
+		state.push_back(particle.getY());
+		state.push_back(particle.getVelocityX());
+		state.push_back(particle.getVelocityY());
+		state.push_back(particle.getSize());
+	}
+	return state;
+}
+
+
+int main() {
+	int failures = 0;
+	const char *path = "checkpoint_test.ckpt";
+	for (int integrator = EXPLICIT_EULER; integrator <= VELOCITY_VERLET; integrator++) {
+		// Spring forces and attraction give the integrators velocity to hold back between steps.
+		Environment env(800, 600);
+		env.setIntegrator((Integrator)integrator);
+		env.setAllowAttract(true);
+		LatticeLayout layout;
+		layout.x = 100;
+		layout.y = 100;
+		layout.strength = 2;
+		env.addLattice(layout);
+		env.addParticles(50, ParticleDistribution(), 5);
+		run(env, 20);
+		if (!env.saveCheckpoint(path)) {
+			printf("FAIL: could not save a checkpoint with %s\n", integrators[integrator]);
+			failures++;
+			continue;
+		}
+		std::unique_ptr<Environment> loaded = Environment::loadCheckpoint(path);
+		if (!loaded || loaded->getIntegrator() != integrator) {
+			printf("FAIL: could not load a checkpoint with %s\n", integrators[integrator]);
+			failures++;
+			continue;
+		}
+		std::vector<float> expected = run(env, 20);
+		std::vector<float> resumed = run(*loaded, 20);
+		if (resumed.size() != expected.size()
+			|| memcmp(resumed.data(), expected.data(), expected.size() * sizeof(float)) != 0) {
+			printf("FAIL: the loaded environment differs with %s\n", integrators[integrator]);
+			failures++;
+		}
+	}
+	remove(path);
+	printf("%s\n", failures ? "FAIL" : "PASS");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,64 @@
+// Checks the spatial queries of the environment against searches of every particle.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "../include/cpparticles.hpp"
+
+static int failures = 0;
+
+
+// Reports a failed check.
+static void check(bool passed, const char *what) {
+	if (!passed) {
+		printf("FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+
+// Particles in the corners of the search box, outside its circle, are still found once the box holds every particle.
+static void testNearestInCorners() {
+	Environment env(100, 100);
+	Particle a = env.addParticle(50, 50, 1);
+	Particle b = env.addParticle(52, 50, 1);
+	Particle c = env.addParticle(2, 2, 1);
+	Particle results[3];
+	int found = env.getNearestParticles(50, 50, 3, results);
+	check(found == 3, "nearest particles in the corners of the box are found");
+	check(found == 3 && results[0] == a && results[1] == b && results[2] == c, "nearest particles are in order");
+}
+
+
+// The nearest particles of a random scene match those found by sorting every particle by distance.
+static void testNearestMatchesSort() {
+	Environment env(1000, 1000);
+	ParticleDistribution distribution;
+	distribution.minSize = 1;
+	distribution.maxSize = 5;
+	env.addParticles(500, distribution, 3);
+	float x = 300;
+	float y = 700;
+	std::vector<float> distances;
+	for (Particle particle : env.getParticles()) {
+		distances.push_back(hypot(particle.getX() - x, particle.getY() - y));
+	}
+	std::sort(distances.begin(), distances.end());
+	for (int k : {1, 10, 500, 600}) {
+		std::vector<Particle> results(k);
+		int found = env.getNearestParticles(x, y, k, results.data());
+		bool same = found == std::min(k, 500);
+		for (int n = 0; same && n < found; n++) {
+			same = hypot(results[n].getX() - x, results[n].getY() - y) == distances[n];
+		}
+		check(same, "nearest particles match a sort of every particle");
+	}
+}
+
+
+int main() {
+	testNearestInCorners();
+	testNearestMatchesSort();
+	printf("%s\n", failures ? "FAIL" : "PASS");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,46 @@
+// Checks that updates of no time, or negative time, leave the particles finite and in place.
+#include <cmath>
+#include <cstdio>
+#include "../include/cpparticles.hpp"
+
+static const char *integrators[] = {"explicit euler", "semi-implicit euler", "velocity verlet"};
+static const char *solvers[] = {"forces", "constraints"};
+
+
+int main() {
+	int failures = 0;
+	for (int integrator = EXPLICIT_EULER; integrator <= VELOCITY_VERLET; integrator++) {
+		for (int solver = SPRING_FORCES; solver <= SPRING_CONSTRAINTS; solver++) {
+			for (float dt : {0.0f, -1.0f}) {
+				Environment env(800, 600);
+				env.setIntegrator((Integrator)integrator);
+				env.setSpringSolver((SpringSolver)solver);
+				env.setMaxSubsteps(4);
+				LatticeLayout layout;
+				layout.x = 100;
+				layout.y = 100;
+				env.addLattice(layout);
+				env.update();
+				float before[300];
+				float after[300];
+				env.exportParticles(before, 100);
+				env.update(dt);
+				env.exportParticles(after, 100);
+				bool same = true;
+				for (int k = 0; k < 300; k++) {
+					same = same && std::isfinite(after[k]) && after[k] == before[k];
+				}
+				for (Particle particle : env.getParticles()) {
+					same = same && std::isfinite(particle.getVelocityX()) && std::isfinite(particle.getVelocityY());
+				}
+				if (!same) {
+					printf("FAIL: update(%g) moved the particles with %s and spring %s\n", dt, integrators[integrator],
+						solvers[solver]);
+					failures++;
+				}
+			}
+		}
+	}
+	printf("%s\n", failures ? "FAIL" : "PASS");
+	return failures ? 1 : 0;
+}